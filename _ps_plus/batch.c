@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "batch.h"
+
+typedef struct BatchRow {
+    int32_t pid;
+    int32_t ppid;
+    uint16_t depth;
+    uint8_t flags;
+    char state;
+    uint32_t threads;
+    uint64_t rss_kb;
+    float cpu_pct;
+    const char *name;
+} BatchRow;
+
+/* Reused from frame to frame */
+static BatchRow *rows;
+static uint32_t rows_cap;
+static char *column_buf;
+static size_t column_cap;
+
+int batch_format(const char *name) {
+    if (strcmp(name, "csv") == 0) return BATCH_CSV;
+    if (strcmp(name, "ndjson") == 0) return BATCH_NDJSON;
+    if (strcmp(name, "bin") == 0) return BATCH_BINARY;
+    return -1;
+}
+
+void batch_write_header(FILE *out, int format) {
+    if (format == BATCH_CSV)
+        fputs("timestamp_ms,sweep,pid,ppid,depth,name,rss_kb,cpu_pct,threads,state\n", out);
+}
+
+/* Walks the tree in display order; returns the row count or -1 */
+static int collect_rows(const ProcessTree *t, const StatsBuffer *stats) {
+    uint32_t n = 0;
+    for (uint32_t id = t->root; id != NODE_NONE; id = tree_next_preorder(t, id, NODE_NONE)) {
+        const ProcessNode *node = &t->nodes[id];
+        if (!(node->flags & NODE_LIVE) || node->pid <= 0) continue;
+        if (n == rows_cap) {
+            uint32_t cap = rows_cap ? rows_cap * 2 : 1024;
+            BatchRow *grown = realloc(rows, cap * sizeof(BatchRow));
+            if (!grown) return -1;
+            rows = grown;
+            rows_cap = cap;
+        }
+        BatchRow *row = &rows[n++];
+        const ProcStats *st = sampler_lookup(stats, t, id);
+        memset(row, 0, sizeof(*row));
+        row->pid = node->pid;
+        row->ppid = node->parent != NODE_NONE ? t->nodes[node->parent].pid : 0;
+        row->depth = node->depth;
+        row->name = tree_name(t, id);
+        if (st) {
+            row->flags = BATCH_ROW_STATS;
+            row->rss_kb = st->rss_kb;
+            row->cpu_pct = st->cpu_usage;
+            if (st->flags & STAT_THREADS) {
+                row->flags |= BATCH_ROW_THREADS;
+                row->threads = st->nr_threads;
+                row->state = st->state;
+            }
+        }
+    }
+    return n;
+}
+
+static void write_csv_name(FILE *out, const char *name) {
+    if (!strpbrk(name, ",\"\n\r")) {
+        fputs(name, out);
+        return;
+    }
+    fputc('"', out);
+    for (const char *p = name; *p; p++) {
+        if (*p == '"')
+            fputc('"', out);
+        fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+static void write_json_name(FILE *out, const char *name) {
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        if (*p == '"' || *p == '\\')
+            fprintf(out, "\\%c", *p);
+        else if (*p < 0x20)
+            fprintf(out, "\\u%04x", *p);
+        else
+            fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+static void write_csv(FILE *out, uint32_t n, unsigned long long sweep, uint64_t ts) {
+    for (uint32_t i = 0; i < n; i++) {
+        const BatchRow *r = &rows[i];
+        fprintf(out, "%llu,%llu,%d,%d,%u,", (unsigned long long)ts, sweep, r->pid, r->ppid, r->depth);
+        write_csv_name(out, r->name);
+        if (r->flags & BATCH_ROW_STATS)
+            fprintf(out, ",%llu,%.2f", (unsigned long long)r->rss_kb, r->cpu_pct);
+        else
+            fputs(",,", out);
+        if (r->flags & BATCH_ROW_THREADS)
+            fprintf(out, ",%u,%c\n", r->threads, r->state);
+        else
+            fputs(",,\n", out);
+    }
+}
+
+static void write_ndjson(FILE *out, uint32_t n, unsigned long long sweep, uint64_t ts) {
+    for (uint32_t i = 0; i < n; i++) {
+        const BatchRow *r = &rows[i];
+        fprintf(out, "{\"ts\":%llu,\"sweep\":%llu,\"pid\":%d,\"ppid\":%d,\"depth\":%u,\"name\":",
+                (unsigned long long)ts, sweep, r->pid, r->ppid, r->depth);
+        write_json_name(out, r->name);
+        if (r->flags & BATCH_ROW_STATS)
+            fprintf(out, ",\"rss_kb\":%llu,\"cpu_pct\":%.2f", (unsigned long long)r->rss_kb, r->cpu_pct);
+        if (r->flags & BATCH_ROW_THREADS)
+            fprintf(out, ",\"threads\":%u,\"state\":\"%c\"", r->threads, r->state);
+        fputs("}\n", out);
+    }
+}
+
+/* CSV and binary frames have a fixed row schema, so only NDJSON gets these */
+int batch_write_exits(FILE *out, int format, const ExitRecord *exits, int n, uint64_t timestamp_ms) {
+    if (format != BATCH_NDJSON) return 0;
+    for (int i = 0; i < n; i++) {
+        const ExitRecord *e = &exits[i];
+        fprintf(out, "{\"ts\":%llu,\"exit\":{\"pid\":%d,\"ppid\":%d,\"name\":",
+                (unsigned long long)timestamp_ms, e->pid, e->ppid);
+        write_json_name(out, e->comm);
+        fprintf(out, ",\"cpu_us\":%llu,\"elapsed_us\":%llu,\"peak_rss_kb\":%llu,\"exit_code\":%u}}\n",
+                (unsigned long long)(e->cpu_ns / 1000), (unsigned long long)(e->elapsed_ns / 1000),
+                (unsigned long long)e->peak_rss_kb, e->exit_code);
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+#define PAD8(n) (((n) + 7) & ~(size_t)7)
+
+/* Copies one field of every row into a padded column at *off */
+#define PUT_COLUMN(field, type) do {                                \
+        type *col = (type *)(column_buf + off);                     \
+        for (uint32_t i = 0; i < n; i++)                            \
+            col[i] = rows[i].field;                                 \
+        off += PAD8(n * sizeof(type));                              \
+    } while (0)
+
+static int write_binary(FILE *out, uint32_t n, unsigned long long sweep, uint64_t ts) {
+    size_t names_len = 0;
+    for (uint32_t i = 0; i < n; i++)
+        names_len += strlen(rows[i].name) + 1;
+    size_t size = PAD8(n * 4) * 2 + PAD8(n * 2) + PAD8(n) * 2 + PAD8(n * 4) +
+                  PAD8(n * 8) + PAD8(n * 4) * 2 + PAD8(names_len);
+    if (size > column_cap) {
+        char *grown = realloc(column_buf, size);
+        if (!grown) return -1;
+        column_buf = grown;
+        column_cap = size;
+    }
+    memset(column_buf, 0, size);
+
+    size_t off = 0;
+    PUT_COLUMN(pid, int32_t);
+    PUT_COLUMN(ppid, int32_t);
+    PUT_COLUMN(depth, uint16_t);
+    PUT_COLUMN(flags, uint8_t);
+    PUT_COLUMN(state, char);
+    PUT_COLUMN(threads, uint32_t);
+    PUT_COLUMN(rss_kb, uint64_t);
+    PUT_COLUMN(cpu_pct, float);
+
+    uint32_t *name_off = (uint32_t *)(column_buf + off);
+    char *names = column_buf + off + PAD8(n * 4);
+    size_t pos = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        size_t len = strlen(rows[i].name) + 1;
+        name_off[i] = pos;
+        memcpy(names + pos, rows[i].name, len);
+        pos += len;
+    }
+
+    struct pt_batch_header hdr = {
+        .magic = PT_BATCH_MAGIC,
+        .version = PT_BATCH_VERSION,
+        .header_size = sizeof(struct pt_batch_header),
+        .count = n,
+        .names_len = names_len,
+        .timestamp_ms = ts,
+        .sweep = sweep,
+        .frame_size = sizeof(struct pt_batch_header) + size,
+    };
+    if (fwrite(&hdr, sizeof(hdr), 1, out) != 1 || fwrite(column_buf, size, 1, out) != 1)
+        return -1;
+    return 0;
+}
+
+/* Returns -1 once the output can no longer be written */
+int batch_write_frame(FILE *out, int format, const ProcessTree *t, const StatsBuffer *stats,
+                      uint64_t timestamp_ms) {
+    int n = collect_rows(t, stats);
+    if (n < 0) return -1;
+    unsigned long long sweep = stats ? stats->sweep : 0;
+    switch (format) {
+        case BATCH_CSV:
+            write_csv(out, n, sweep, timestamp_ms);
+            break;
+        case BATCH_NDJSON:
+            write_ndjson(out, n, sweep, timestamp_ms);
+            break;
+        case BATCH_BINARY:
+            if (write_binary(out, n, sweep, timestamp_ms) < 0) return -1;
+            break;
+    }
+    if (fflush(out) != 0 || ferror(out)) return -1;
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/*
+ * Headless output for ps_plus: one frame per sampler sweep, every live
+ * process in tree order, as CSV, NDJSON or binary columnar frames.
+ *
+ * A binary frame is a pt_batch_header followed by one array per column,
+ * each count entries long and padded to 8 bytes:
+ *   int32 pid, int32 ppid, uint16 depth, uint8 flags, char state,
+ *   uint32 threads, uint64 rss_kb, float cpu_pct, uint32 name_off
+ * then names_len bytes of NUL-terminated names that name_off points into.
+ * Rows without BATCH_ROW_STATS have zero stats columns.
+ *
+ * NDJSON streams also carry one {"exit": ...} line per process that
+ * exited since the previous frame, when taskstats is available.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ps_tree.h"
+#include "sampler.h"
+#include "proc_events.h"
+
+#define BATCH_CSV     0
+#define BATCH_NDJSON  1
+#define BATCH_BINARY  2
+
+#define PT_BATCH_MAGIC    0x50544246   /* "PTBF" */
+#define PT_BATCH_VERSION  1
+
+#define BATCH_ROW_STATS    0x1
+#define BATCH_ROW_THREADS  0x2
+
+struct pt_batch_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t count;
+    uint32_t names_len;
+    uint64_t timestamp_ms;
+    uint64_t sweep;
+    uint64_t frame_size;    /* bytes, header included */
+};
+
+int batch_format(const char *name);
+void batch_write_header(FILE *out, int format);
+int batch_write_frame(FILE *out, int format, const ProcessTree *t, const StatsBuffer *stats,
+                      uint64_t timestamp_ms);
+int batch_write_exits(FILE *out, int format, const ExitRecord *exits, int n, uint64_t timestamp_ms);
+
+#endif
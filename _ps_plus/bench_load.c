@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ps_tree.h"
+
+/*
+ * Times tree_load_bin() and tree_load_text() on synthetic snapshots:
+ *   wide  - one parent with every other process as a direct child
+ *   deep  - back-to-back fork chains, each MAX_CHAIN processes deep
+ *   mixed - a few wide parents with shallow random subtrees below them
+ *
+ * usage: bench_load [nodes] [iterations]
+ */
+
+#define MAX_CHAIN 512
+
+typedef enum { SHAPE_WIDE, SHAPE_DEEP, SHAPE_MIXED } Shape;
+
+static const char *shape_names[] = { "wide", "deep", "mixed" };
+
+static int shape_depth(Shape shape, int i, int *depths) {
+    switch (shape) {
+        case SHAPE_WIDE:
+            return i == 0 ? 0 : 1;
+        case SHAPE_DEEP:
+            return i % MAX_CHAIN;
+        case SHAPE_MIXED:
+        default:
+            if (i < 2) return i;
+            if (i % 1000 == 0) return 1;
+            /* depth wanders between 2 and 12 below the last wide parent */
+            int d = depths[i - 1] + 1 - rand() % 3;
+            if (d < 2) d = 2;
+            if (d > depths[i - 1] + 1) d = depths[i - 1] + 1;
+            return d > 12 ? 12 : d;
+    }
+}
+
+static int write_snapshot(Shape shape, int nodes, char *bin_path, char *text_path) {
+    int bin_fd = mkstemp(bin_path);
+    int text_fd = mkstemp(text_path);
+    if (bin_fd < 0 || text_fd < 0) return -1;
+    FILE *bin = fdopen(bin_fd, "w");
+    FILE *text = fdopen(text_fd, "w");
+    int *depths = malloc(nodes * sizeof(int));
+    if (!bin || !text || !depths) return -1;
+
+    struct pt_header hdr = {
+        .magic = PT_MAGIC,
+        .version = PT_VERSION,
+        .header_size = sizeof(struct pt_header),
+        .record_size = sizeof(struct pt_record),
+    };
+    fwrite(&hdr, sizeof(hdr), 1, bin);
+
+    srand(1);
+    for (int i = 0; i < nodes; i++) {
+        struct pt_record rec = {0};
+        depths[i] = shape_depth(shape, i, depths);
+        rec.pid = i + 1;
+        rec.tgid = i + 1;
+        rec.depth = depths[i];
+        rec.state = 'S';
+        snprintf(rec.comm, sizeof(rec.comm), "proc-%d", i % 64);
+        fwrite(&rec, sizeof(rec), 1, bin);
+        fprintf(text, "%*s%s [%d]\n", rec.depth * 2, "", rec.comm, rec.pid);
+    }
+    free(depths);
+    fclose(bin);
+    fclose(text);
+    return 0;
+}
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void time_loader(const char *label, int (*load)(ProcessTree *, const char *),
+                        const char *path, int nodes, int iterations) {
+    ProcessTree *t = malloc(sizeof(ProcessTree));
+    double best = 0, total = 0;
+    tree_init(t);
+    for (int i = 0; i < iterations; i++) {
+        tree_reset(t);
+        double start = now_ms();
+        if (load(t, path) < 0) {
+            fprintf(stderr, "%s: load failed\n", label);
+            break;
+        }
+        double elapsed = now_ms() - start;
+        total += elapsed;
+        if (i == 0 || elapsed < best) best = elapsed;
+    }
+    printf("  %-5s %8u nodes  best %8.2f ms  avg %8.2f ms  %6.1f ns/node  %u rows\n",
+           label, t->count, best, total / iterations, best * 1e6 / nodes, t->visible_rows);
+    tree_free(t);
+    free(t);
+}
+
+int main(int argc, char **argv) {
+    int nodes = argc > 1 ? atoi(argv[1]) : 100000;
+    int iterations = argc > 2 ? atoi(argv[2]) : 5;
+    if (nodes < 2 || iterations < 1) {
+        fprintf(stderr, "usage: %s [nodes] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    for (Shape shape = SHAPE_WIDE; shape <= SHAPE_MIXED; shape++) {
+        char bin_path[] = "/tmp/bench_tree_bin_XXXXXX";
+        char text_path[] = "/tmp/bench_tree_txt_XXXXXX";
+        if (write_snapshot(shape, nodes, bin_path, text_path) < 0) {
+            perror("Failed to write snapshot");
+            return 1;
+        }
+        printf("%s:\n", shape_names[shape]);
+        time_loader("bin", tree_load_bin, bin_path, nodes, iterations);
+        time_loader("text", tree_load_text, text_path, nodes, iterations);
+        unlink(bin_path);
+        unlink(text_path);
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "event_sources.h"
+#include "proc_sample.h"
+
+/* The module's event ring, read from the generation the tree was loaded at */
+static void open_tree_events(EventSources *es, const ProcessTree *t) {
+    if (es->events_fd < 0)
+        es->events_fd = open("/proc/" PT_PROC_EVENTS, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (es->events_fd < 0) return;
+    char since[32];
+    int len = snprintf(since, sizeof(since), "%llu", t->generation);
+    if (write(es->events_fd, since, len) != len) {
+        close(es->events_fd);
+        es->events_fd = -1;
+    }
+}
+
+/* Loads t, which must be freshly reset; returns tree_load()'s result */
+int event_sources_open(EventSources *es, ProcessTree *t) {
+    memset(es, 0, sizeof(*es));
+    es->events_fd = -1;
+    tree_init(&es->fresh);
+    /* the connector and taskstats need CAP_NET_ADMIN */
+    es->connector_fd = proc_events_open();
+    es->exits_fd = exit_stats_open();
+    es->synced_ns = monotonic_ns();
+    int err = tree_load(t);
+    if (es->connector_fd < 0)
+        open_tree_events(es, t);
+    return err;
+}
+
+void event_sources_close(EventSources *es) {
+    if (es->connector_fd >= 0)
+        close(es->connector_fd);
+    if (es->events_fd >= 0)
+        close(es->events_fd);
+    if (es->exits_fd >= 0)
+        close(es->exits_fd);
+    tree_free(&es->fresh);
+    es->connector_fd = es->events_fd = es->exits_fd = -1;
+}
+
+const char *event_sources_name(const EventSources *es) {
+    return es->connector_fd >= 0 ? "connector" : es->events_fd >= 0 ? "module" : "none";
+}
+
+/* Fills up to three pollfds for the open sources; returns how many */
+int event_sources_pollfds(const EventSources *es, struct pollfd *fds) {
+    int sources[3] = { es->connector_fd, es->events_fd, es->exits_fd }, n = 0;
+    for (int i = 0; i < 3; i++)
+        if (sources[i] >= 0)
+            fds[n++] = (struct pollfd){ .fd = sources[i], .events = POLLIN };
+    return n;
+}
+
+/*
+ * Folds pending fork and exit events into t. Returns 1 if t changed, 0
+ * if not, -1 if events were lost and a resync is needed. Caller holds
+ * the tree's lock.
+ */
+int event_sources_apply(EventSources *es, ProcessTree *t) {
+    if (es->connector_fd >= 0)
+        return proc_events_apply(es->connector_fd, t);
+    if (es->events_fd >= 0)
+        return tree_apply_events(t, es->events_fd);
+    return 0;
+}
+
+int event_sources_resync_due(const EventSources *es) {
+    int following = es->connector_fd >= 0 || es->events_fd >= 0;
+    uint64_t period = (following ? RESYNC_SECONDS : POLL_SECONDS) * 1000000000ULL;
+    return monotonic_ns() - es->synced_ns >= period;
+}
+
+/* Loads the scratch tree for event_sources_sync(); needs no lock, only one caller at a time */
+int event_sources_load(EventSources *es) {
+    tree_reset(&es->fresh);
+    es->fresh_loaded = tree_load(&es->fresh) == 0;
+    return es->fresh_loaded ? 0 : -1;
+}
+
+/*
+ * Reconciles t with the scratch tree and restarts the module's event
+ * ring from its generation. Returns 1 if t changed. Caller holds the
+ * tree's lock.
+ */
+int event_sources_sync(EventSources *es, ProcessTree *t) {
+    int changed = 0;
+    es->synced_ns = monotonic_ns();
+    if (es->fresh_loaded)
+        changed = tree_sync(t, &es->fresh);
+    es->fresh_loaded = 0;
+    if (es->events_fd >= 0)
+        open_tree_events(es, t);
+    return changed;
+}
+
+/* Reads the next batch of exit records into es->exits; returns how many */
+int event_sources_read_exits(EventSources *es) {
+    if (es->exits_fd < 0) return 0;
+    int n = exit_stats_read(es->exits_fd, es->exits, EXIT_BATCH);
+    if (n > 0) {
+        es->exits_seen += n;
+        es->last_exit = es->exits[n - 1];
+    }
+    return n > 0 ? n : 0;
+}
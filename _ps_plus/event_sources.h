@@ -0,0 +1,55 @@
+#ifndef EVENT_SOURCES_H
+#define EVENT_SOURCES_H
+
+/*
+ * Keeps a ProcessTree current from whichever event source the host
+ * offers, shared by ps_plus and memplot.
+ *
+ * event_sources_open() subscribes to the proc connector and taskstats
+ * first and loads the tree after, so nothing forked in between is
+ * missed. Without the connector, the module's event ring is read from
+ * the generation the tree was loaded at. With neither, the tree is only
+ * as fresh as its last resync.
+ *
+ * A resync loads a snapshot into a scratch tree and reconciles, so node
+ * ids survive. It is split in two so the slow part can run without the
+ * tree's lock: event_sources_load() fills the scratch tree, then
+ * event_sources_sync() applies it under the lock. Resyncs are due every
+ * RESYNC_SECONDS while following events, since the connector misses
+ * some changes, every POLL_SECONDS without events, and at once after
+ * events were lost.
+ */
+
+#include <stdint.h>
+#include <poll.h>
+
+#include "ps_tree.h"
+#include "proc_events.h"
+
+#define RESYNC_SECONDS  30
+#define POLL_SECONDS    2
+#define EXIT_BATCH      64
+
+typedef struct EventSources {
+    int connector_fd;
+    int events_fd;          /* the module's event ring, when there is no connector */
+    int exits_fd;
+    uint64_t synced_ns;     /* CLOCK_MONOTONIC of the last load or resync */
+    ProcessTree fresh;      /* scratch tree for resyncs */
+    int fresh_loaded;
+    ExitRecord exits[EXIT_BATCH];   /* the last batch read */
+    unsigned long long exits_seen;
+    ExitRecord last_exit;
+} EventSources;
+
+int event_sources_open(EventSources *es, ProcessTree *t);
+void event_sources_close(EventSources *es);
+const char *event_sources_name(const EventSources *es);
+int event_sources_pollfds(const EventSources *es, struct pollfd *fds);
+int event_sources_apply(EventSources *es, ProcessTree *t);
+int event_sources_resync_due(const EventSources *es);
+int event_sources_load(EventSources *es);
+int event_sources_sync(EventSources *es, ProcessTree *t);
+int event_sources_read_exits(EventSources *es);
+
+#endif
@@ -5,43 +5,716 @@
 #include <linux/sched/signal.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
+#include <linux/sched/mm.h>
+#include <linux/rcupdate.h>
+#include <linux/rculist.h>
+#include <linux/pid.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/uaccess.h>
+#include <linux/tracepoint.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/pid_namespace.h>
+
+#include "process_tree.h"
+#include "task_walk.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Uday Gopan");
 MODULE_DESCRIPTION("Linux Kernel Module for graphical representation of process tree"); 
 MODULE_VERSION("0.1");
 
-static void print_process_tree(struct seq_file *m, struct task_struct *task, int level)
+#define EVENT_RING_SIZE 4096   /* power of two */
+#define RING_WALK_CHUNK 256    /* tasks per rcu_read_lock() section */
+
+static unsigned int ring_interval_ms = 1000;
+module_param(ring_interval_ms, uint, 0644);
+MODULE_PARM_DESC(ring_interval_ms, "Collection interval of " PT_RING_DEV " in ms");
+
+static unsigned int ring_size_kb = 8192;
+module_param(ring_size_kb, uint, 0444);
+MODULE_PARM_DESC(ring_size_kb, "Size of the " PT_RING_DEV " data area, rounded up to a power of two");
+
+/*
+ * Fork/exit events from the sched tracepoints. Event number g lives in
+ * event_ring[g % EVENT_RING_SIZE] until it is overwritten EVENT_RING_SIZE
+ * events later; pt_generation is the number of the newest event.
+ */
+static struct pt_event event_ring[EVENT_RING_SIZE];
+static atomic64_t pt_generation = ATOMIC64_INIT(0);
+static DEFINE_SPINLOCK(event_lock);
+static DECLARE_WAIT_QUEUE_HEAD(event_wait);
+static struct tracepoint *tp_fork, *tp_exit;
+
+/*
+ * One bit per tgid, set once its EXIT has been recorded. Several threads
+ * of a group exiting together can all see signal->live at zero, and only
+ * the first may report. A new leader taking the tgid clears the bit;
+ * the pid can't be reused before every old thread has passed probe_exit.
+ */
+static unsigned long *exit_reported;
+
+static void record_event(int type, struct task_struct *task)
+{
+    struct pt_event *ev;
+    unsigned long flags;
+    u64 gen;
+
+    spin_lock_irqsave(&event_lock, flags);
+    gen = atomic64_inc_return(&pt_generation);
+    ev = &event_ring[gen & (EVENT_RING_SIZE - 1)];
+    ev->generation = gen;
+    ev->type = type;
+    ev->pid = task->tgid;
+    rcu_read_lock();
+    ev->ppid = rcu_dereference(task->real_parent)->tgid;
+    rcu_read_unlock();
+    ev->reserved = 0;
+    strscpy(ev->comm, task->comm, sizeof(ev->comm));
+    spin_unlock_irqrestore(&event_lock, flags);
+
+    wake_up_interruptible(&event_wait);
+}
+
+static void probe_fork(void *data, struct task_struct *parent, struct task_struct *child)
+{
+    if (thread_group_leader(child)) {
+        clear_bit(child->tgid, exit_reported);
+        record_event(PT_EVENT_FORK, child);
+    }
+}
+
+/* Fires per thread; only report once the whole thread group is gone, and only once */
+static void probe_exit(void *data, struct task_struct *task)
+{
+    if (atomic_read(&task->signal->live) == 0 && !test_and_set_bit(task->tgid, exit_reported))
+        record_event(PT_EVENT_EXIT, task);
+}
+
+static void lookup_tracepoint(struct tracepoint *tp, void *priv)
+{
+    if (!strcmp(tp->name, "sched_process_fork"))
+        tp_fork = tp;
+    else if (!strcmp(tp->name, "sched_process_exit"))
+        tp_exit = tp;
+}
+
+/*
+ * Iterator state kept across read() calls. The tree is walked in pre-order
+ * without recursion; after each page the walk stops and the next start()
+ * resumes from the remembered task instead of re-walking from init_task.
+ */
+struct tree_iter {
+    loff_t pos;     /* index of the task remembered below, -1 if none */
+    pid_t  pid;     /* global, as in task->pid */
+    u64    start_time;  /* tells the task apart from a later one with its pid */
+    int    depth;
+    int    binary;  /* position 0 is the pt_header */
+    int    stats;   /* fill the per-task counters in each record */
+};
+
+static int task_depth(struct task_struct *task)
+{
+    int depth = 0;
+
+    while (task != &init_task) {
+        task = rcu_dereference(task->real_parent);
+        depth++;
+    }
+    return depth;
+}
+
+/* Pre-order successor over the whole tree; caller holds rcu_read_lock() */
+static struct task_struct *next_task(struct task_struct *task, int *depth)
+{
+    return task_walk_next(&init_task, task, depth);
+}
+
+static void *remember_task(struct tree_iter *it, struct task_struct *task, loff_t n)
+{
+    if (task) {
+        it->pos = n;
+        it->pid = task->pid;
+        it->start_time = task->start_time;
+    } else {
+        it->pos = -1;
+    }
+    return task;
+}
+
+static void *tree_start(struct seq_file *m, loff_t *pos)
+{
+    struct tree_iter *it = m->private;
+    struct task_struct *task;
+    loff_t n, i;
+
+    rcu_read_lock();
+    if (it->binary && *pos == 0)
+        return SEQ_START_TOKEN;
+
+    n = *pos - it->binary;
+    if (n > 0 && n == it->pos) {
+        task = pid_task(find_pid_ns(it->pid, &init_pid_ns), PIDTYPE_PID);
+        if (task && pid_alive(task) && task->start_time == it->start_time) {
+            it->depth = task_depth(task);
+            return task;
+        }
+    }
+
+    task = &init_task;
+    it->depth = 0;
+    for (i = 0; task && i < n; i++)
+        task = next_task(task, &it->depth);
+    return remember_task(it, task, n);
+}
+
+static void *tree_next(struct seq_file *m, void *v, loff_t *pos)
+{
+    struct tree_iter *it = m->private;
+    struct task_struct *task;
+
+    (*pos)++;
+    if (v == SEQ_START_TOKEN) {
+        it->depth = 0;
+        task = &init_task;
+    } else {
+        task = next_task(v, &it->depth);
+    }
+    return remember_task(it, task, *pos - it->binary);
+}
+
+static void tree_stop(struct seq_file *m, void *v)
+{
+    rcu_read_unlock();
+}
+
+static int tree_show(struct seq_file *m, void *v)
 {
-    struct task_struct *child;
-    struct list_head *list;
+    struct tree_iter *it = m->private;
+    struct task_struct *task = v;
 
-    seq_printf(m, "%*s%s [%d]\n", level * 2, "", task->comm, task->pid);
+    seq_printf(m, "%*s%s [%d]\n", it->depth * 2, "", task->comm, task->pid);
+    return 0;
+}
+
+/* Fill one fixed-size record; caller holds rcu_read_lock() */
+static void fill_record(struct pt_record *rec, struct task_struct *task, int level, int stats)
+{
+    struct task_struct *t;
+    struct mm_struct *mm;
+    u64 utime, stime, runtime;
 
-    list_for_each(list, &task->children) {
-        child = list_entry(list, struct task_struct, sibling);
-        print_process_tree(m, child, level + 1);
+    memset(rec, 0, sizeof(*rec));
+    rec->pid = task->pid;
+    rec->tgid = task->tgid;
+    rec->ppid = pid_alive(task) ? rcu_dereference(task->real_parent)->tgid : 0;
+    rec->depth = level;
+    rec->state = task_state_to_char(task);
+    strscpy(rec->comm, task->comm, sizeof(rec->comm));
+    if (!stats)
+        return;
+
+    task_lock(task);
+    mm = task->mm;
+    if (mm)
+        rec->rss_kb = get_mm_rss(mm) << (PAGE_SHIFT - 10);
+    task_unlock(task);
+
+    /* same sums as thread_group_cputime(), without its seqlock retry */
+    utime = task->signal->utime;
+    stime = task->signal->stime;
+    runtime = task->signal->sum_sched_runtime;
+    for_each_thread(task, t) {
+        utime += t->utime;
+        stime += t->stime;
+        runtime += t->se.sum_exec_runtime;
     }
+    rec->utime_ns = utime;
+    rec->stime_ns = stime;
+    rec->runtime_ns = runtime;
+    rec->start_time_ns = task->start_boottime;
+    rec->nr_threads = get_nr_threads(task);
 }
 
-static int seq_show(struct seq_file *m, void *v)
+static int bin_show(struct seq_file *m, void *v)
 {
-    print_process_tree(m, &init_task, 0);
+    struct tree_iter *it = m->private;
+    struct pt_header hdr = {
+        .magic       = PT_MAGIC,
+        .version     = PT_VERSION,
+        .header_size = sizeof(struct pt_header),
+        .record_size = sizeof(struct pt_record),
+    };
+    struct pt_record rec;
+
+    if (v == SEQ_START_TOKEN) {
+        hdr.generation = atomic64_read(&pt_generation);
+        hdr.flags = it->stats ? PT_FLAG_STATS : 0;
+        seq_write(m, &hdr, sizeof(hdr));
+        return 0;
+    }
+    fill_record(&rec, v, it->depth, it->stats);
+    seq_write(m, &rec, sizeof(rec));
+    return 0;
+}
+
+static const struct seq_operations tree_seq_ops = {
+    .start = tree_start,
+    .next  = tree_next,
+    .stop  = tree_stop,
+    .show  = tree_show
+};
+
+static const struct seq_operations bin_seq_ops = {
+    .start = tree_start,
+    .next  = tree_next,
+    .stop  = tree_stop,
+    .show  = bin_show
+};
+
+static int open_tree(struct file *file, const struct seq_operations *ops, int binary, int stats)
+{
+    struct tree_iter *it = __seq_open_private(file, ops, sizeof(*it));
+
+    if (!it)
+        return -ENOMEM;
+    it->pos = -1;
+    it->binary = binary;
+    it->stats = stats;
     return 0;
 }
 
 static int proc_open(struct inode *inode, struct file *file)
 {
-    return single_open(file, seq_show, NULL);
+    return open_tree(file, &tree_seq_ops, 0, 0);
+}
+
+static int bin_open(struct inode *inode, struct file *file)
+{
+    return open_tree(file, &bin_seq_ops, 1, 0);
+}
+
+static int stats_open(struct inode *inode, struct file *file)
+{
+    return open_tree(file, &bin_seq_ops, 1, 1);
 }
 
 static const struct proc_ops proc_fops = {
     .proc_open    = proc_open,
     .proc_read    = seq_read,
     .proc_lseek   = seq_lseek,
-    .proc_release = single_release
+    .proc_release = seq_release_private
+};
+
+static const struct proc_ops bin_fops = {
+    .proc_open    = bin_open,
+    .proc_read    = seq_read,
+    .proc_lseek   = seq_lseek,
+    .proc_release = seq_release_private
+};
+
+static const struct proc_ops stats_fops = {
+    .proc_open    = stats_open,
+    .proc_read    = seq_read,
+    .proc_lseek   = seq_lseek,
+    .proc_release = seq_release_private
+};
+
+/* Per-open cursor into the event ring */
+struct event_reader {
+    u64 since;
+};
+
+static int events_open(struct inode *inode, struct file *file)
+{
+    struct event_reader *r = kzalloc(sizeof(*r), GFP_KERNEL);
+
+    if (!r)
+        return -ENOMEM;
+    file->private_data = r;
+    return nonseekable_open(inode, file);
+}
+
+static int events_release(struct inode *inode, struct file *file)
+{
+    kfree(file->private_data);
+    return 0;
+}
+
+static ssize_t events_write(struct file *file, const char __user *buffer, size_t count, loff_t *pos)
+{
+    struct event_reader *r = file->private_data;
+    char kbuf[24];
+    u64 since;
+
+    if (count >= sizeof(kbuf))
+        return -EINVAL;
+
+    if (copy_from_user(kbuf, buffer, count))
+        return -EFAULT;
+
+    kbuf[count] = '\0';
+    if (kstrtoull(kbuf, 10, &since) < 0)
+        return -EINVAL;
+
+    r->since = since;
+    return count;
+}
+
+static ssize_t events_read(struct file *file, char __user *buffer, size_t count, loff_t *pos)
+{
+    struct event_reader *r = file->private_data;
+    struct pt_header hdr = {
+        .magic       = PT_EVENT_MAGIC,
+        .version     = PT_VERSION,
+        .header_size = sizeof(struct pt_header),
+        .record_size = sizeof(struct pt_event),
+    };
+    struct pt_event *out;
+    size_t max, n = 0;
+    u64 gen, oldest, g;
+
+    if (count < sizeof(hdr))
+        return -EINVAL;
+
+    max = min_t(size_t, (count - sizeof(hdr)) / sizeof(*out), EVENT_RING_SIZE);
+    out = kvmalloc_array(max ? max : 1, sizeof(*out), GFP_KERNEL);
+    if (!out)
+        return -ENOMEM;
+
+    spin_lock_irq(&event_lock);
+    gen = atomic64_read(&pt_generation);
+    oldest = gen >= EVENT_RING_SIZE ? gen - EVENT_RING_SIZE + 1 : 1;
+    if (r->since + 1 < oldest) {
+        hdr.flags = PT_FLAG_OVERFLOW;
+        r->since = gen;
+    } else {
+        for (g = r->since + 1; g <= gen && n < max; g++)
+            out[n++] = event_ring[g & (EVENT_RING_SIZE - 1)];
+        r->since += n;
+    }
+    spin_unlock_irq(&event_lock);
+    hdr.generation = r->since;
+
+    if (copy_to_user(buffer, &hdr, sizeof(hdr)) ||
+        copy_to_user(buffer + sizeof(hdr), out, n * sizeof(*out))) {
+        kvfree(out);
+        return -EFAULT;
+    }
+    kvfree(out);
+    return sizeof(hdr) + n * sizeof(*out);
+}
+
+static __poll_t events_poll(struct file *file, poll_table *wait)
+{
+    struct event_reader *r = file->private_data;
+
+    poll_wait(file, &event_wait, wait);
+    if ((u64)atomic64_read(&pt_generation) > r->since)
+        return EPOLLIN | EPOLLRDNORM;
+    return 0;
+}
+
+static const struct proc_ops events_fops = {
+    .proc_open    = events_open,
+    .proc_read    = events_read,
+    .proc_write   = events_write,
+    .proc_poll    = events_poll,
+    .proc_release = events_release
+};
+
+/*
+ * Shared stats ring behind /dev/process_tree_ring (layout in
+ * process_tree.h). It exists only while the device is open: the first
+ * open allocates it and starts ring_work, the last release stops and
+ * frees it. Every client maps the same pages, so one walk per interval
+ * serves them all.
+ */
+static DEFINE_MUTEX(ring_lock);
+static int ring_users;
+static struct pt_ring_control *ring;    /* control page, then the data area */
+static size_t ring_data_size;
+static struct pt_record *ring_staging;  /* one walk, before it goes into the ring */
+static size_t ring_max_records;
+static DECLARE_WAIT_QUEUE_HEAD(ring_wait);
+static void ring_collect(struct work_struct *work);
+static DECLARE_DELAYED_WORK(ring_work, ring_collect);
+
+/*
+ * Walks the tree like tree_start()/tree_next(), dropping the RCU read
+ * lock every RING_WALK_CHUNK tasks so a large tree doesn't stall the
+ * grace period. Returns the number of records filled.
+ */
+static size_t ring_walk(struct pt_record *out, size_t max, u32 *flags)
+{
+    struct task_struct *task;
+    pid_t next_pid = 0;
+    u64 next_start = 0;
+    bool resume = false;
+    size_t n = 0, i;
+    int depth = 0;
+
+    for (;;) {
+        rcu_read_lock();
+        task = &init_task;
+        if (resume) {
+            task = pid_task(find_pid_ns(next_pid, &init_pid_ns), PIDTYPE_PID);
+            if (task && pid_alive(task) && task->start_time == next_start) {
+                depth = task_depth(task);
+            } else {
+                /* the task we stopped at is gone, or its pid reused; find our place again from the top */
+                task = &init_task;
+                depth = 0;
+                for (i = 0; task && i < n; i++)
+                    task = next_task(task, &depth);
+            }
+        }
+        for (i = 0; task && i < RING_WALK_CHUNK && n < max; i++) {
+            fill_record(&out[n++], task, depth, 1);
+            task = next_task(task, &depth);
+        }
+        if (task) {
+            next_pid = task->pid;
+            next_start = task->start_time;
+        }
+        rcu_read_unlock();
+
+        if (!task)
+            return n;
+        if (n == max) {
+            *flags |= PT_FLAG_TRUNCATED;
+            return n;
+        }
+        resume = true;
+        cond_resched();
+    }
+}
+
+static char *ring_data(void)
+{
+    return (char *)ring + PAGE_SIZE;
+}
+
+/* Position of the frame after the one at pos */
+static u64 ring_next(u64 pos)
+{
+    u64 room = ring_data_size - (pos & (ring_data_size - 1));
+    const struct pt_frame *frame;
+
+    if (room < sizeof(*frame))
+        return pos + room;
+    frame = (const struct pt_frame *)(ring_data() + (pos & (ring_data_size - 1)));
+    return pos + frame->size;
+}
+
+static void ring_publish(size_t count, u32 flags, u64 timestamp, u64 generation)
+{
+    u64 size = sizeof(struct pt_frame) + count * sizeof(struct pt_record);
+    u64 start = ring->head, tail = ring->tail;
+    u64 room = ring_data_size - (start & (ring_data_size - 1));
+    struct pt_frame *frame;
+
+    if (room < size)
+        start += room;
+    while (start + size - tail > ring_data_size)
+        tail = ring_next(tail);
+    WRITE_ONCE(ring->tail, tail);
+    smp_wmb();
+
+    if (start != ring->head && room >= sizeof(*frame)) {
+        frame = (struct pt_frame *)(ring_data() + (ring->head & (ring_data_size - 1)));
+        memset(frame, 0, sizeof(*frame));
+        frame->magic = PT_FRAME_PAD;
+        frame->size = room;
+    }
+    frame = (struct pt_frame *)(ring_data() + (start & (ring_data_size - 1)));
+    frame->magic = PT_FRAME_MAGIC;
+    frame->flags = flags;
+    frame->count = count;
+    frame->size = size;
+    frame->seq = ring->frames + 1;
+    frame->timestamp_ns = timestamp;
+    frame->generation = generation;
+    memcpy(frame + 1, ring_staging, count * sizeof(struct pt_record));
+    smp_wmb();
+
+    WRITE_ONCE(ring->last_frame, start);
+    WRITE_ONCE(ring->frames, ring->frames + 1);
+    smp_store_release(&ring->head, start + size);
+}
+
+static void ring_collect(struct work_struct *work)
+{
+    u64 timestamp = ktime_get_ns();
+    u64 generation = atomic64_read(&pt_generation);
+    u32 flags = PT_FLAG_STATS;
+    size_t count = ring_walk(ring_staging, ring_max_records, &flags);
+
+    ring_publish(count, flags, timestamp, generation);
+    wake_up_interruptible(&ring_wait);
+    WRITE_ONCE(ring->interval_ms, READ_ONCE(ring_interval_ms) ?: 1);
+    schedule_delayed_work(&ring_work, msecs_to_jiffies(ring->interval_ms));
+}
+
+static int ring_alloc(void)
+{
+    size_t data_size = roundup_pow_of_two(max_t(size_t, ring_size_kb, 64) * 1024);
+
+    ring = vmalloc_user(PAGE_SIZE + data_size);
+    if (!ring)
+        return -ENOMEM;
+    ring_data_size = data_size;
+    /* a frame may use half the ring, so the newest always survives the next */
+    ring_max_records = (data_size / 2 - sizeof(struct pt_frame)) / sizeof(struct pt_record);
+    ring_staging = kvmalloc_array(ring_max_records, sizeof(struct pt_record), GFP_KERNEL);
+    if (!ring_staging) {
+        vfree(ring);
+        ring = NULL;
+        return -ENOMEM;
+    }
+    ring->magic = PT_RING_MAGIC;
+    ring->version = PT_VERSION;
+    ring->header_size = sizeof(*ring);
+    ring->record_size = sizeof(struct pt_record);
+    ring->interval_ms = READ_ONCE(ring_interval_ms) ?: 1;
+    ring->data_offset = PAGE_SIZE;
+    ring->data_size = data_size;
+    return 0;
+}
+
+static void ring_free(void)
+{
+    kvfree(ring_staging);
+    vfree(ring);
+    ring_staging = NULL;
+    ring = NULL;
+}
+
+/* Per-open: the last frame poll() reported */
+struct ring_reader {
+    u64 seen;
+};
+
+static int ring_open(struct inode *inode, struct file *file)
+{
+    struct ring_reader *r = kzalloc(sizeof(*r), GFP_KERNEL);
+    int ret = 0;
+
+    if (!r)
+        return -ENOMEM;
+    mutex_lock(&ring_lock);
+    if (ring_users == 0) {
+        ret = ring_alloc();
+        if (!ret)
+            schedule_delayed_work(&ring_work, 0);
+    }
+    if (!ret) {
+        ring_users++;
+        WRITE_ONCE(r->seen, READ_ONCE(ring->frames));
+    }
+    mutex_unlock(&ring_lock);
+
+    if (ret) {
+        kfree(r);
+        return ret;
+    }
+    file->private_data = r;
+    return nonseekable_open(inode, file);
+}
+
+/* Mappings hold the file open, so the ring outlives every one of them */
+static int ring_release(struct inode *inode, struct file *file)
+{
+    kfree(file->private_data);
+    mutex_lock(&ring_lock);
+    if (--ring_users == 0) {
+        cancel_delayed_work_sync(&ring_work);
+        ring_free();
+    }
+    mutex_unlock(&ring_lock);
+    return 0;
+}
+
+static int ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    vm_flags_clear(vma, VM_MAYWRITE);
+    return remap_vmalloc_range(vma, ring, vma->vm_pgoff);
+}
+
+/* Readable once per frame published since the last poll that said so */
+static __poll_t ring_poll(struct file *file, poll_table *wait)
+{
+    struct ring_reader *r = file->private_data;
+    u64 frames;
+
+    poll_wait(file, &ring_wait, wait);
+    frames = READ_ONCE(ring->frames);
+    /* several threads may poll one file; each sees seen whole, at worst both report a frame */
+    if (frames == READ_ONCE(r->seen))
+        return 0;
+    WRITE_ONCE(r->seen, frames);
+    return EPOLLIN | EPOLLRDNORM;
+}
+
+static const struct file_operations ring_fops = {
+    .owner   = THIS_MODULE,
+    .open    = ring_open,
+    .release = ring_release,
+    .mmap    = ring_mmap,
+    .poll    = ring_poll,
 };
 
+static struct miscdevice ring_dev = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name  = PT_RING_DEV,
+    .fops  = &ring_fops,
+    .mode  = 0444,
+};
+
+static int register_event_probes(void)
+{
+    int ret;
+
+    for_each_kernel_tracepoint(lookup_tracepoint, NULL);
+    if (!tp_fork || !tp_exit)
+        return -ENOENT;
+
+    exit_reported = vzalloc(BITS_TO_LONGS(PID_MAX_LIMIT) * sizeof(long));
+    if (!exit_reported)
+        return -ENOMEM;
+    ret = tracepoint_probe_register(tp_fork, probe_fork, NULL);
+    if (ret)
+        goto err_free;
+    ret = tracepoint_probe_register(tp_exit, probe_exit, NULL);
+    if (ret) {
+        tracepoint_probe_unregister(tp_fork, probe_fork, NULL);
+        tracepoint_synchronize_unregister();
+        goto err_free;
+    }
+    return 0;
+
+err_free:
+    vfree(exit_reported);
+    return ret;
+}
+
+static void unregister_event_probes(void)
+{
+    tracepoint_probe_unregister(tp_exit, probe_exit, NULL);
+    tracepoint_probe_unregister(tp_fork, probe_fork, NULL);
+    tracepoint_synchronize_unregister();
+    vfree(exit_reported);
+}
+
 static int __init ps_plus_init(void)
 {
     struct proc_dir_entry *entry = proc_create("process_tree", 0, NULL, &proc_fops);
@@ -49,12 +722,48 @@ static int __init ps_plus_init(void)
         printk(KERN_ERR "Failed to create /proc/process_tree\n");
         return -ENOMEM;
     }
+    if (!proc_create(PT_PROC_BIN, 0, NULL, &bin_fops)) {
+        printk(KERN_ERR "Failed to create /proc/%s\n", PT_PROC_BIN);
+        remove_proc_entry("process_tree", NULL);
+        return -ENOMEM;
+    }
+    if (!proc_create(PT_PROC_STATS, 0, NULL, &stats_fops)) {
+        printk(KERN_ERR "Failed to create /proc/%s\n", PT_PROC_STATS);
+        goto err_bin;
+    }
+    if (register_event_probes()) {
+        printk(KERN_ERR "Failed to attach sched_process_fork/exit probes\n");
+        goto err_stats;
+    }
+    if (!proc_create(PT_PROC_EVENTS, 0666, NULL, &events_fops)) {
+        printk(KERN_ERR "Failed to create /proc/%s\n", PT_PROC_EVENTS);
+        unregister_event_probes();
+        goto err_stats;
+    }
+    if (misc_register(&ring_dev)) {
+        printk(KERN_ERR "Failed to register /dev/%s\n", PT_RING_DEV);
+        remove_proc_entry(PT_PROC_EVENTS, NULL);
+        unregister_event_probes();
+        goto err_stats;
+    }
     printk(KERN_INFO "Loading Process Tree Module...\n");
     return 0;
+
+err_stats:
+    remove_proc_entry(PT_PROC_STATS, NULL);
+err_bin:
+    remove_proc_entry(PT_PROC_BIN, NULL);
+    remove_proc_entry("process_tree", NULL);
+    return -ENODEV;
 }
 
 static void __exit ps_plus_exit(void)
 {
+    misc_deregister(&ring_dev);
+    remove_proc_entry(PT_PROC_EVENTS, NULL);
+    unregister_event_probes();
+    remove_proc_entry(PT_PROC_STATS, NULL);
+    remove_proc_entry(PT_PROC_BIN, NULL);
     remove_proc_entry("process_tree", NULL);
     printk(KERN_INFO "Kernel Module Removed Successfully\n");
 }
@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include <linux/taskstats.h>
+#include <linux/acct.h>
+
+#include "proc_events.h"
+
+#define RECV_BUF_SIZE  (1 << 20)    /* socket buffer; a fork storm overflows it later */
+#define MSG_BUF_SIZE   8192
+
+#define NLA_DATA(nla) ((char *)(nla) + NLA_HDRLEN)
+
+/*
+ * Thread groups that have lost threads but not their last one, keyed by
+ * tgid with linear probing. Each slot holds the group's exit record so
+ * far: CPU time summed over its exited threads, the leader's details
+ * once the leader has gone.
+ */
+static ExitRecord *groups;
+static uint32_t groups_size, groups_used;
+
+static int netlink_socket(int protocol, unsigned groups) {
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, protocol);
+    if (fd < 0) return -1;
+    int size = RECV_BUF_SIZE;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK, .nl_groups = groups };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* Returns the payload length of attribute type within [attrs, attrs + len), or -1 */
+static int find_attr(const char *attrs, int len, int type, const char **data) {
+    while (len >= NLA_HDRLEN) {
+        const struct nlattr *nla = (const struct nlattr *)attrs;
+        if (nla->nla_len < NLA_HDRLEN || nla->nla_len > len)
+            return -1;
+        if ((nla->nla_type & NLA_TYPE_MASK) == type) {
+            *data = NLA_DATA(nla);
+            return nla->nla_len - NLA_HDRLEN;
+        }
+        len -= NLA_ALIGN(nla->nla_len);
+        attrs += NLA_ALIGN(nla->nla_len);
+    }
+    return -1;
+}
+
+/* Returns the socket, or -1 without CAP_NET_ADMIN or connector support */
+int proc_events_open(void) {
+    int fd = netlink_socket(NETLINK_CONNECTOR, CN_IDX_PROC);
+    if (fd < 0) return -1;
+
+    char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))] = {0};
+    struct nlmsghdr *nl = (struct nlmsghdr *)buf;
+    struct cn_msg *cn = NLMSG_DATA(nl);
+    enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+    nl->nlmsg_len = NLMSG_LENGTH(sizeof(*cn) + sizeof(op));
+    nl->nlmsg_type = NLMSG_DONE;
+    cn->id.idx = CN_IDX_PROC;
+    cn->id.val = CN_VAL_PROC;
+    cn->len = sizeof(op);
+    memcpy(cn->data, &op, sizeof(op));
+    if (send(fd, buf, nl->nlmsg_len, 0) < 0 || set_nonblocking(fd) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int read_comm(int pid, char *comm, size_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, comm, size - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    comm[n] = '\0';
+    comm[strcspn(comm, "\n")] = '\0';
+    return strlen(comm);
+}
+
+/* Threads tgid still has, a zombie leader included, as /proc/<tgid>/status counts them; 0 once it is gone */
+static int group_threads(int tgid) {
+    char path[64], buf[4096];
+    snprintf(path, sizeof(path), "/proc/%d/status", tgid);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+    const char *line = strstr(buf, "\nThreads:");
+    return line ? atoi(line + strlen("\nThreads:")) : 0;
+}
+
+static int apply_event(ProcessTree *t, const struct proc_event *ev) {
+    char comm[PT_COMM_LEN + 1];
+    uint32_t id;
+    int len;
+    switch (ev->what) {
+        case PROC_EVENT_FORK: {
+            const struct fork_proc_event *f = &ev->event_data.fork;
+            if (f->child_pid != f->child_tgid)
+                return 0;
+            /* the child runs under its parent's name until it execs */
+            id = tree_find_pid(t, f->parent_tgid);
+            if (id != NODE_NONE)
+                len = snprintf(comm, sizeof(comm), "%s", tree_name(t, id));
+            else if ((len = read_comm(f->child_tgid, comm, sizeof(comm))) < 0)
+                return 0;
+            return tree_fork(t, f->child_tgid, f->parent_tgid, comm, len);
+        }
+        case PROC_EVENT_EXEC:
+            id = tree_find_pid(t, ev->event_data.exec.process_tgid);
+            if (id == NODE_NONE || (len = read_comm(ev->event_data.exec.process_tgid, comm, sizeof(comm))) < 0)
+                return 0;
+            tree_rename(t, id, comm, len);
+            return 1;
+        case PROC_EVENT_COMM:
+            if (ev->event_data.comm.process_pid != ev->event_data.comm.process_tgid)
+                return 0;
+            id = tree_find_pid(t, ev->event_data.comm.process_tgid);
+            if (id == NODE_NONE)
+                return 0;
+            tree_rename(t, id, ev->event_data.comm.comm, strnlen(ev->event_data.comm.comm, PT_COMM_LEN));
+            return 1;
+        case PROC_EVENT_EXIT: {
+            /*
+             * A leader that exits before its other threads stays as a
+             * zombie, and so does its node, until the last thread goes.
+             * Each thread is released before its exit event is sent, so
+             * by then /proc counts only the ones left.
+             */
+            int tgid = ev->event_data.exit.process_tgid;
+            id = tree_find_pid(t, tgid);
+            if (id == NODE_NONE)
+                return 0;
+            if (ev->event_data.exit.process_pid == tgid)
+                t->nodes[id].flags |= NODE_LEADER_EXITED;
+            else if (!(t->nodes[id].flags & NODE_LEADER_EXITED))
+                return 0;
+            if (group_threads(tgid) > 1)
+                return 0;
+            return tree_exit(t, tgid);
+        }
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Drains the connector socket into t. Returns 1 if the tree changed, 0 if
+ * not, -1 if the socket overflowed and the caller has to resync.
+ */
+int proc_events_apply(int fd, ProcessTree *t) {
+    static char buf[MSG_BUF_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+    int changed = 0;
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0)
+            return errno == ENOBUFS ? -1 : changed;
+        int len = n;
+        for (struct nlmsghdr *nl = (struct nlmsghdr *)buf; NLMSG_OK(nl, len); nl = NLMSG_NEXT(nl, len)) {
+            const struct cn_msg *cn = NLMSG_DATA(nl);
+            if (nl->nlmsg_type != NLMSG_DONE || cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC ||
+                cn->len < sizeof(struct proc_event))
+                continue;
+            changed |= apply_event(t, (const struct proc_event *)cn->data);
+        }
+    }
+}
+
+static int genl_request(int fd, uint16_t family, uint8_t cmd, uint16_t attr, const void *data, size_t len) {
+    char buf[NLMSG_SPACE(GENL_HDRLEN + NLA_HDRLEN + 256)] = {0};
+    if (len > 256) return -1;
+    struct nlmsghdr *nl = (struct nlmsghdr *)buf;
+    struct genlmsghdr *genl = NLMSG_DATA(nl);
+    struct nlattr *nla = (struct nlattr *)((char *)genl + GENL_HDRLEN);
+    nl->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN + NLA_HDRLEN + len);
+    nl->nlmsg_type = family;
+    nl->nlmsg_flags = NLM_F_REQUEST;
+    genl->cmd = cmd;
+    genl->version = 1;
+    nla->nla_type = attr;
+    nla->nla_len = NLA_HDRLEN + len;
+    memcpy(NLA_DATA(nla), data, len);
+    return send(fd, buf, nl->nlmsg_len, 0) < 0 ? -1 : 0;
+}
+
+static int taskstats_family(int fd) {
+    static char buf[MSG_BUF_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+    if (genl_request(fd, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, CTRL_ATTR_FAMILY_NAME,
+                     TASKSTATS_GENL_NAME, sizeof(TASKSTATS_GENL_NAME)) < 0)
+        return -1;
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    const struct nlmsghdr *nl = (const struct nlmsghdr *)buf;
+    if (n < 0 || !NLMSG_OK(nl, n) || nl->nlmsg_type == NLMSG_ERROR)
+        return -1;
+    const char *attrs = (const char *)NLMSG_DATA(nl) + GENL_HDRLEN, *id;
+    if (find_attr(attrs, nl->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), CTRL_ATTR_FAMILY_ID, &id) < 2)
+        return -1;
+    uint16_t family;
+    memcpy(&family, id, sizeof(family));
+    return family;
+}
+
+/* Returns the socket, or -1 without CAP_NET_ADMIN or taskstats support */
+int exit_stats_open(void) {
+    int fd = netlink_socket(NETLINK_GENERIC, 0);
+    if (fd < 0) return -1;
+    int family = taskstats_family(fd);
+    char mask[32];
+    int len = snprintf(mask, sizeof(mask), "0-%ld", sysconf(_SC_NPROCESSORS_CONF) - 1);
+    if (family < 0 ||
+        genl_request(fd, family, TASKSTATS_CMD_GET, TASKSTATS_CMD_ATTR_REGISTER_CPUMASK, mask, len + 1) < 0 ||
+        set_nonblocking(fd) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static uint32_t group_hash(int32_t tgid) {
+    return ((uint32_t)tgid * 2654435761u) & (groups_size - 1);
+}
+
+/* The pending record for tgid; with add, a new zeroed one if there is none */
+static ExitRecord *group_find(int32_t tgid, int add) {
+    if (add && (groups_used + 1) * 2 > groups_size) {
+        uint32_t size = groups_size ? groups_size * 2 : 64;
+        ExitRecord *grown = calloc(size, sizeof(ExitRecord)), *old = groups;
+        if (!grown) return NULL;
+        uint32_t old_size = groups_size;
+        groups = grown;
+        groups_size = size;
+        for (uint32_t i = 0; i < old_size; i++) {
+            if (!old[i].pid) continue;
+            uint32_t h = group_hash(old[i].pid);
+            while (groups[h].pid)
+                h = (h + 1) & (size - 1);
+            groups[h] = old[i];
+        }
+        free(old);
+    }
+    if (!groups_size) return NULL;
+    uint32_t h = group_hash(tgid);
+    for (; groups[h].pid; h = (h + 1) & (groups_size - 1))
+        if (groups[h].pid == tgid)
+            return &groups[h];
+    if (!add) return NULL;
+    groups[h].pid = tgid;
+    groups_used++;
+    return &groups[h];
+}
+
+/* Backward-shift deletion, so probes never need tombstones */
+static void group_remove(ExitRecord *slot) {
+    uint32_t i = slot - groups, mask = groups_size - 1;
+    for (uint32_t j = (i + 1) & mask; groups[j].pid; j = (j + 1) & mask) {
+        uint32_t h = group_hash(groups[j].pid);
+        if (((j - h) & mask) >= ((j - i) & mask)) {
+            groups[i] = groups[j];
+            i = j;
+        }
+    }
+    memset(&groups[i], 0, sizeof(groups[i]));
+    groups_used--;
+}
+
+/*
+ * Every exiting thread sends its own record. The group's last one is
+ * flagged AGROUP and, for a multithreaded group, comes with a
+ * TASKSTATS_TYPE_AGGR_TGID record as well. That record only carries
+ * delay accounting, so CPU time is summed from the thread records here
+ * and the group is reported once, when its last thread exits.
+ */
+static int parse_exit(const struct nlmsghdr *nl, ExitRecord *rec) {
+    const char *attrs = (const char *)NLMSG_DATA(nl) + GENL_HDRLEN, *aggr, *data;
+    int attrs_len = nl->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+    int len = find_attr(attrs, attrs_len, TASKSTATS_TYPE_AGGR_PID, &aggr);
+    if (len < 0 || (len = find_attr(aggr, len, TASKSTATS_TYPE_STATS, &data)) < 0)
+        return 0;
+
+    /* older kernels send a shorter struct; the missing tail reads as zero */
+    struct taskstats ts;
+    memset(&ts, 0, sizeof(ts));
+    memcpy(&ts, data, (size_t)len < sizeof(ts) ? (size_t)len : sizeof(ts));
+    int32_t tgid = ts.ac_tgid ? ts.ac_tgid : ts.ac_pid;
+    int last = (ts.ac_flag & AGROUP) != 0;
+    uint32_t tgid_attr;
+    if ((len = find_attr(attrs, attrs_len, TASKSTATS_TYPE_AGGR_TGID, &aggr)) >= 0 &&
+        find_attr(aggr, len, TASKSTATS_TYPE_TGID, &data) >= (int)sizeof(tgid_attr)) {
+        memcpy(&tgid_attr, data, sizeof(tgid_attr));
+        tgid = tgid_attr;
+        last = 1;
+    }
+
+    ExitRecord *group = group_find(tgid, !last);
+    if (!group && !last)
+        return 0;   /* out of memory: this thread's time is lost */
+    if (last) {
+        memset(rec, 0, sizeof(*rec));
+        if (group) {
+            *rec = *group;
+            group_remove(group);
+        }
+        group = rec;
+        group->pid = tgid;
+        group->exit_code = ts.ac_exitcode;
+    }
+    group->cpu_ns += (ts.ac_utime + ts.ac_stime) * 1000;
+    if (ts.hiwater_rss > group->peak_rss_kb)
+        group->peak_rss_kb = ts.hiwater_rss;
+    /* the leader's lifetime and name stand for the process; the last thread's if it was never seen */
+    if (ts.ac_pid == (uint32_t)tgid || !group->comm[0]) {
+        group->ppid = ts.ac_ppid;
+        group->elapsed_ns = ts.ac_etime * 1000;
+        memcpy(group->comm, ts.ac_comm, sizeof(group->comm) - 1);
+    }
+    return last;
+}
+
+/* Returns how many exit records were stored in out, up to max */
+int exit_stats_read(int fd, ExitRecord *out, int max) {
+    static char buf[MSG_BUF_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+    int count = 0;
+    while (count < max) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0) {
+            /* records lost to overflow are gone; keep reading the rest */
+            if (errno == ENOBUFS) continue;
+            break;
+        }
+        int len = n;
+        for (struct nlmsghdr *nl = (struct nlmsghdr *)buf; NLMSG_OK(nl, len) && count < max;
+             nl = NLMSG_NEXT(nl, len)) {
+            if (nl->nlmsg_type != NLMSG_ERROR && nl->nlmsg_type != NLMSG_DONE)
+                count += parse_exit(nl, &out[count]);
+        }
+    }
+    return count;
+}
@@ -0,0 +1,47 @@
+#ifndef PROC_EVENTS_H
+#define PROC_EVENTS_H
+
+/*
+ * Event-driven process tracking straight from the kernel, without the
+ * module's event ring.
+ *
+ * The proc connector (NETLINK_CONNECTOR, CN_IDX_PROC) multicasts fork,
+ * exec, comm and exit events as they happen; proc_events_apply() folds
+ * the process-level ones into a ProcessTree. Thread events are skipped,
+ * except that a process whose leader has exited is removed only with its
+ * last thread.
+ *
+ * Taskstats (generic netlink) delivers an accounting record for every
+ * task that exits on a registered CPU, so processes too short-lived for
+ * any sample still leave their CPU time and peak RSS behind. Thread
+ * records are summed per thread group and one ExitRecord is produced
+ * when the group's last thread exits; threads that exited before the
+ * socket was opened are missing from the sum.
+ *
+ * Both need CAP_NET_ADMIN. The open calls return -1 without it and the
+ * caller falls back to /proc/process_tree.events.
+ */
+
+#include <stdint.h>
+
+#include "ps_tree.h"
+
+#define EXIT_COMM_LEN 32
+
+typedef struct ExitRecord {
+    int32_t pid;
+    int32_t ppid;
+    uint32_t exit_code;     /* as from wait() */
+    uint64_t cpu_ns;        /* user + system time, summed over the threads */
+    uint64_t elapsed_ns;
+    uint64_t peak_rss_kb;
+    char comm[EXIT_COMM_LEN];
+} ExitRecord;
+
+int proc_events_open(void);
+int proc_events_apply(int fd, ProcessTree *t);
+
+int exit_stats_open(void);
+int exit_stats_read(int fd, ExitRecord *out, int max);
+
+#endif
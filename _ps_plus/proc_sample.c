@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "proc_sample.h"
+
+#define HISTORY_TTL 64      /* sweeps an unseen entry is kept; covers viewport backoff */
+
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static ssize_t read_small(const char *path, char *buf, size_t size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+/* Returns the number of /proc files read, or 0 if the process is gone */
+int proc_sample_read(int pid, ProcSample *out) {
+    char path[64], buf[1024];
+    static long ticks, page_kb;
+    if (!ticks) {
+        ticks = sysconf(_SC_CLK_TCK);
+        page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    }
+
+    memset(out, 0, sizeof(*out));
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    if (read_small(path, buf, sizeof(buf)) < 0)
+        return 0;
+    out->at_ns = monotonic_ns();
+
+    /* comm may hold spaces and parentheses; the fields resume after the last ')' */
+    char *p = strrchr(buf, ')');
+    unsigned long utime, stime, minflt, majflt;
+    unsigned long long start_time;
+    long nr_threads;
+    if (!p || sscanf(p + 2, "%c %*d %*d %*d %*d %*d %*u %lu %*u %lu %*u %lu %lu"
+                     " %*d %*d %*d %*d %ld %*d %llu",
+                     &out->state, &minflt, &majflt, &utime, &stime, &nr_threads, &start_time) != 7)
+        return 0;
+    out->pid = pid;
+    out->minflt = minflt;
+    out->majflt = majflt;
+    out->nr_threads = nr_threads;
+    out->start_time = start_time;
+    out->runtime_ns = (uint64_t)(utime + stime) * (1000000000ULL / ticks);
+    out->runtime_source = RUNTIME_TICKS;
+    int reads = 1;
+
+    /* stat's rss field is a per-CPU approximation; statm's is summed exactly */
+    unsigned long size, resident;
+    snprintf(path, sizeof(path), "/proc/%d/statm", pid);
+    if (read_small(path, buf, sizeof(buf)) >= 0) {
+        reads++;
+        if (sscanf(buf, "%lu %lu", &size, &resident) == 2) {
+            out->vm_kb = size * page_kb;
+            out->rss_kb = resident * page_kb;
+        }
+    }
+    if (nr_threads != 1)
+        return reads;
+
+    unsigned long long runtime;
+    snprintf(path, sizeof(path), "/proc/%d/schedstat", pid);
+    if (read_small(path, buf, sizeof(buf)) < 0)
+        return reads;
+    if (sscanf(buf, "%llu", &runtime) == 1) {
+        out->runtime_ns = runtime;
+        out->runtime_source = RUNTIME_SCHEDSTAT;
+    }
+    return reads + 1;
+}
+
+/* VmSwap from /proc/<pid>/status; returns 0, or -1 if it couldn't be read */
+int proc_sample_swap(int pid, uint64_t *swap_kb) {
+    char path[64], buf[4096];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    if (read_small(path, buf, sizeof(buf)) < 0)
+        return -1;
+    const char *line = strstr(buf, "\nVmSwap:");
+    unsigned long long kb;
+    if (!line || sscanf(line + 8, "%llu", &kb) != 1) {
+        *swap_kb = 0;   /* kernel threads have no Vm* lines */
+        return 0;
+    }
+    *swap_kb = kb;
+    return 0;
+}
+
+void cpu_history_init(CpuHistory *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void cpu_history_free(CpuHistory *h) {
+    free(h->slots);
+    cpu_history_init(h);
+}
+
+static uint32_t history_slot(const CpuHistory *h, int32_t pid, uint64_t start_time) {
+    uint64_t key = ((uint64_t)(uint32_t)pid << 32) ^ start_time;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key & (h->size - 1);
+}
+
+static CpuHistoryEntry *history_find(CpuHistory *h, int32_t pid, uint64_t start_time) {
+    uint32_t slot = history_slot(h, pid, start_time);
+    while (h->slots[slot].pid &&
+           (h->slots[slot].pid != pid || h->slots[slot].start_time != start_time))
+        slot = (slot + 1) & (h->size - 1);
+    return &h->slots[slot];
+}
+
+/* Rebuilds the table at a size fit for the live entries, dropping expired ones */
+static int history_rebuild(CpuHistory *h) {
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < h->size; i++)
+        if (h->slots[i].pid && h->slots[i].seen + HISTORY_TTL >= h->epoch)
+            live++;
+    uint32_t size = 1024;
+    while (size < live * 4)
+        size *= 2;
+
+    CpuHistory next = { calloc(size, sizeof(CpuHistoryEntry)), size, 0, h->epoch, h->online_cpus };
+    if (!next.slots) return -1;
+    for (uint32_t i = 0; i < h->size; i++) {
+        const CpuHistoryEntry *e = &h->slots[i];
+        if (!e->pid || e->seen + HISTORY_TTL < h->epoch) continue;
+        *history_find(&next, e->pid, e->start_time) = *e;
+        next.used++;
+    }
+    free(h->slots);
+    *h = next;
+    return 0;
+}
+
+/* Call once per sweep, before its cpu_history_update() calls */
+void cpu_history_begin(CpuHistory *h) {
+    h->epoch++;
+    h->online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (h->online_cpus < 1)
+        h->online_cpus = 1;
+    if (h->size && h->epoch % HISTORY_TTL == 0)
+        history_rebuild(h);
+}
+
+/*
+ * Records s and returns its CPU usage since the previous sample of the
+ * same process, in percent of all online CPUs. The first sample, or one
+ * whose runtime came from a different source, only sets the baseline.
+ */
+double cpu_history_update(CpuHistory *h, const ProcSample *s) {
+    if ((h->used + 1) * 2 > h->size && history_rebuild(h) < 0)
+        return 0.0;
+    CpuHistoryEntry *e = history_find(h, s->pid, s->start_time);
+    double usage = 0.0;
+    if (!e->pid) {
+        e->pid = s->pid;
+        e->start_time = s->start_time;
+        h->used++;
+    } else if (e->runtime_source == s->runtime_source && s->at_ns > e->at_ns &&
+               s->runtime_ns >= e->runtime_ns) {
+        usage = (double)(s->runtime_ns - e->runtime_ns) /
+                ((double)(s->at_ns - e->at_ns) * h->online_cpus) * 100.0;
+    }
+    e->runtime_source = s->runtime_source;
+    e->runtime_ns = s->runtime_ns;
+    e->at_ns = s->at_ns;
+    e->seen = h->epoch;
+    return usage;
+}
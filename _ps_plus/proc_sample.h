@@ -0,0 +1,64 @@
+#ifndef PROC_SAMPLE_H
+#define PROC_SAMPLE_H
+
+/*
+ * Per-process sampling shared by ps_plus and memplot.
+ *
+ * proc_sample_read() reads /proc/<pid>/stat and statm, plus the
+ * nanosecond runtime from /proc/<pid>/schedstat when the process has a
+ * single thread. schedstat covers the main thread only, so multithreaded
+ * processes fall back to utime + stime at clock tick resolution.
+ *
+ * CpuHistory keeps the last runtime of each process keyed by
+ * (pid, start_time): a reused pid never inherits another process's
+ * baseline, and history survives the tree being rebuilt. Usage is
+ * runtime over wall time times online CPUs, i.e. a share of the machine.
+ */
+
+#include <stdint.h>
+
+#define RUNTIME_TICKS      1    /* utime + stime from stat */
+#define RUNTIME_SCHEDSTAT  2    /* main thread runtime in ns */
+#define RUNTIME_KERNEL     3    /* all threads' runtime in ns, from the stats dump */
+
+typedef struct ProcSample {
+    int32_t pid;
+    char state;
+    uint8_t runtime_source;
+    uint32_t nr_threads;
+    uint64_t start_time;    /* clock ticks after boot, as in stat */
+    uint64_t runtime_ns;
+    uint64_t at_ns;         /* CLOCK_MONOTONIC when runtime was read */
+    uint64_t rss_kb;
+    uint64_t vm_kb;         /* total mapped, from statm */
+    uint64_t minflt;        /* page faults since start, as in stat */
+    uint64_t majflt;
+} ProcSample;
+
+typedef struct CpuHistoryEntry {
+    int32_t pid;
+    uint8_t runtime_source;
+    uint64_t start_time;
+    uint64_t runtime_ns;
+    uint64_t at_ns;
+    unsigned long long seen;
+} CpuHistoryEntry;
+
+typedef struct CpuHistory {
+    CpuHistoryEntry *slots;
+    uint32_t size;          /* power of two, or 0 */
+    uint32_t used;
+    unsigned long long epoch;
+    int online_cpus;
+} CpuHistory;
+
+uint64_t monotonic_ns(void);
+int proc_sample_read(int pid, ProcSample *out);
+int proc_sample_swap(int pid, uint64_t *swap_kb);
+
+void cpu_history_init(CpuHistory *h);
+void cpu_history_free(CpuHistory *h);
+void cpu_history_begin(CpuHistory *h);
+double cpu_history_update(CpuHistory *h, const ProcSample *s);
+
+#endif
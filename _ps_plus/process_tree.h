@@ -0,0 +1,121 @@
+#ifndef PROCESS_TREE_H
+#define PROCESS_TREE_H
+
+/*
+ * Binary layout of /proc/process_tree.bin, shared by kernel_mod.c and
+ * ps_plus_user.c. A pt_header is followed by fixed-size pt_record entries
+ * in pre-order (parents before children) until EOF.
+ *
+ * /proc/process_tree.stats has the same layout with PT_FLAG_STATS set in
+ * the header: rss_kb, utime_ns, stime_ns, nr_threads, start_time_ns and
+ * runtime_ns are filled in.
+ * process_tree.bin leaves them zero so the plain walk stays cheap.
+ *
+ * /proc/process_tree.events answers "what changed since generation N":
+ * write N as decimal text, then each read() returns a pt_header with
+ * PT_EVENT_MAGIC followed by pt_event entries. header.generation is the
+ * generation to continue from; PT_FLAG_OVERFLOW means N has fallen out
+ * of the ring and the reader must reload the full tree.
+ *
+ * /dev/process_tree_ring is a read-only mmap of one kernel collection
+ * pass shared by every client. While it is open the module walks the
+ * tree every interval_ms and appends a pt_frame holding the same records
+ * as process_tree.stats. The mapping starts with a pt_ring_control page;
+ * frames follow at data_offset, in a ring of data_size bytes addressed
+ * by ever-growing byte positions (offset = position % data_size).
+ *
+ * A frame never wraps: when it doesn't fit before the end of the ring, a
+ * PT_FRAME_PAD frame fills the rest, or the remainder is skipped outright
+ * if it is too short even for a pt_frame. The module advances tail past
+ * anything it is about to overwrite before writing, then publishes
+ * last_frame and head with release ordering. Readers take last_frame (or
+ * walk from their own position up to head), use the records in place and
+ * then re-read tail: if it moved past the frame's position the frame was
+ * overwritten meanwhile and must be discarded. A frame is at most half
+ * the ring, so the newest one survives until the one after next.
+ *
+ * Only these records go through the ring. memplot's /proc/mem_tree files
+ * answer per-pid queries and are read directly, not from frames.
+ */
+
+#include <linux/types.h>
+
+#define PT_PROC_BIN     "process_tree.bin"
+#define PT_PROC_STATS   "process_tree.stats"
+#define PT_PROC_EVENTS  "process_tree.events"
+#define PT_RING_DEV     "process_tree_ring"
+#define PT_MAGIC        0x50545245   /* "PTRE" */
+#define PT_EVENT_MAGIC  0x50544556   /* "PTEV" */
+#define PT_RING_MAGIC   0x50545247   /* "PTRG" */
+#define PT_FRAME_MAGIC  0x50544652   /* "PTFR" */
+#define PT_FRAME_PAD    0x50545044   /* "PTPD" */
+#define PT_VERSION      4
+#define PT_COMM_LEN     16
+
+#define PT_FLAG_OVERFLOW  0x1
+#define PT_FLAG_STATS     0x2
+#define PT_FLAG_TRUNCATED 0x4   /* the frame ran out of room before the walk ended */
+
+#define PT_EVENT_FORK  1
+#define PT_EVENT_EXIT  2
+
+struct pt_header {
+    __u32 magic;
+    __u16 version;
+    __u16 header_size;
+    __u32 record_size;
+    __u32 flags;
+    __u64 generation;
+};
+
+struct pt_record {
+    __s32 pid;
+    __s32 ppid;
+    __s32 tgid;
+    __u16 depth;
+    char  state;
+    __u8  reserved;
+    char  comm[PT_COMM_LEN];
+    __u64 rss_kb;
+    __u64 utime_ns;
+    __u64 stime_ns;
+    __u32 nr_threads;
+    __u32 reserved2;
+    __u64 start_time_ns;    /* boot-based, the clock behind stat's starttime */
+    __u64 runtime_ns;       /* scheduler runtime of all threads, live and reaped */
+};
+
+struct pt_event {
+    __u64 generation;
+    __s32 type;
+    __s32 pid;
+    __s32 ppid;
+    __u32 reserved;
+    char  comm[PT_COMM_LEN];
+};
+
+struct pt_ring_control {
+    __u32 magic;
+    __u16 version;
+    __u16 header_size;
+    __u32 record_size;
+    __u32 interval_ms;
+    __u64 data_offset;      /* from the start of the mapping, page aligned */
+    __u64 data_size;        /* power of two */
+    __u64 head;             /* end of the newest frame */
+    __u64 tail;             /* oldest position not yet overwritten */
+    __u64 last_frame;       /* position of the newest frame */
+    __u64 frames;           /* frames written, the newest one's seq */
+};
+
+struct pt_frame {
+    __u32 magic;
+    __u32 flags;
+    __u32 count;            /* pt_records that follow */
+    __u32 size;             /* bytes from this header to the next frame */
+    __u64 seq;
+    __u64 timestamp_ns;     /* CLOCK_MONOTONIC at the start of the walk */
+    __u64 generation;       /* event generation at the start of the walk */
+};
+
+#endif
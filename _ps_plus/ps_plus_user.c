@@ -4,268 +4,448 @@
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <getopt.h>
+#include <limits.h>
+#include <errno.h>
 
-#define MAX_VISIBLE_NODES 1024
-
-typedef struct ProcessNode {
-    char name[256];
-    int pid;
-    int depth;
-    int collapsed;
-    char details[512];      
-    unsigned long prev_cpu_time; 
-    double cpu_usage;       
-    struct ProcessNode *child;  
-    struct ProcessNode *next;  
-} ProcessNode;
-
-ProcessNode *head = NULL;
-
-ProcessNode *visible_nodes[MAX_VISIBLE_NODES];
-int visible_count = 0;
-int selected_index = 0;
-int scroll_offset = 0; 
-
-void flatten_tree_recursive(ProcessNode *node) {
-    if (!node) return;
-    if (visible_count < MAX_VISIBLE_NODES)
-        visible_nodes[visible_count++] = node;
-    if (!node->collapsed)
-        flatten_tree_recursive(node->child);
-    flatten_tree_recursive(node->next);
-}
+#include "ps_tree.h"
+#include "sampler.h"
+#include "screen.h"
+#include "batch.h"
+#include "rank.h"
+#include "event_sources.h"
+
+#define VIEW_TREE    0
+#define VIEW_RANKED  1
+
+ProcessTree tree;
+Screen screen;
+
+int view = VIEW_TREE;
+int rank_key = RANK_CPU;
+uint32_t *ranked = NULL;
+uint32_t ranked_cap = 0;
+uint32_t ranked_count = 0;
+uint32_t ranked_total = 0;
+
+uint32_t selected_index = 0;
+uint32_t scroll_offset = 0;
+uint32_t drawn_scroll = 0;
+unsigned long long drawn_sweep = 0;
+unsigned long long drawn_exits = 0;
+
+uint32_t *drawn_ids = NULL;
+uint32_t drawn_count = 0;
 
-void flatten_tree() {
-    visible_count = 0;
-    flatten_tree_recursive(head);
+SamplerCounters last_counters;
+double last_counters_at = 0;
+double reads_per_sec[3];
+
+pthread_mutex_t tree_lock = PTHREAD_MUTEX_INITIALIZER;
+EventSources sources;
+
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-void add_process_node(const char *line) {
-    int space_count = 0;
-    while (line[space_count] == ' ') space_count++;
-    int depth = space_count / 2; 
+void load_process_tree() {
+    if (event_sources_open(&sources, &tree) < 0)
+        perror("Failed to read /proc");
+}
 
-    char proc_name[256] = {0};
-    int pid = -1;
-    if (sscanf(line + space_count, "%255s [%d]", proc_name, &pid) != 2) {
-        strncpy(proc_name, line + space_count, 255);
+/*
+ * Returns 1 if the tree changed; caller must hold tree_lock. Lost events
+ * and the periodic resync reconcile with a snapshot, keeping node ids,
+ * collapse state and the selection.
+ */
+int apply_tree_events() {
+    int changed = event_sources_apply(&sources, &tree);
+    if (changed < 0 || event_sources_resync_due(&sources)) {
+        event_sources_load(&sources);
+        changed = event_sources_sync(&sources, &tree) || changed < 0;
     }
+    return changed;
+}
 
-    ProcessNode *new_node = malloc(sizeof(ProcessNode));
-    if (!new_node) return;
-    strncpy(new_node->name, proc_name, 255);
-    new_node->pid = pid;
-    new_node->depth = depth;
-    new_node->collapsed = 0;
-    new_node->child = NULL;
-    new_node->next = NULL;
-    new_node->prev_cpu_time = 0;
-    new_node->cpu_usage = 0.0;
-    snprintf(new_node->details, sizeof(new_node->details),
-             "Process: %s (PID: %d)\nMemory Usage: N/A\nCPU Usage: N/A", new_node->name, new_node->pid);
-
-    static ProcessNode *parent_stack[50] = {NULL};
-    if (depth == 0) {
-        new_node->next = head;
-        head = new_node;
-    } else {
-        ProcessNode *parent = parent_stack[depth - 1];
-        if (parent) {
-            if (!parent->child) {
-                parent->child = new_node;
-            } else {
-                ProcessNode *sibling = parent->child;
-                while (sibling->next)
-                    sibling = sibling->next;
-                sibling->next = new_node;
-            }
-        } else {
-            new_node->next = head;
-            head = new_node;
-        }
-    }
-    parent_stack[depth] = new_node;
+/* Returns 0 if drawn_ids could not hold max_rows entries */
+int reserve_drawn(int max_rows) {
+    uint32_t *grown = realloc(drawn_ids, (max_rows > 0 ? max_rows : 1) * sizeof(uint32_t));
+    if (grown)
+        drawn_ids = grown;
+    drawn_count = 0;
+    return grown != NULL;
 }
 
-void free_process_nodes(ProcessNode *node) {
-    if (!node) return;
-    free_process_nodes(node->child);
-    free_process_nodes(node->next);
-    free(node);
+uint32_t view_rows() {
+    return view == VIEW_TREE ? tree.visible_rows : ranked_total;
 }
 
-unsigned long long get_global_cpu_time() {
-    FILE *fp = fopen("/proc/stat", "r");
-    if (!fp) return 0;
-    char buffer[1024];
-    if (!fgets(buffer, sizeof(buffer), fp)) {
-        fclose(fp);
-        return 0;
+void render_visible_tree() {
+    int max_rows = LINES - 4;
+    int track = reserve_drawn(max_rows);
+    uint32_t id = tree_visible_at(&tree, scroll_offset);
+    for (int y = 0; id != NODE_NONE && y < max_rows; y++, id = tree_visible_next(&tree, id)) {
+        ProcessNode *node = &tree.nodes[id];
+        if (track)
+            drawn_ids[drawn_count++] = id;
+        int x = 2 + node->depth * 4;
+        int attr = scroll_offset + y == selected_index ? A_REVERSE : 0;
+        if (node->collapsed && node->child != NODE_NONE)
+            screen_put(&screen, y, x, attr, "[+] %s  (subtree: %.2f%% CPU, %llu kB)", tree_name(&tree, id),
+                       node->subtree_cpu_centi / 100.0, (unsigned long long)node->subtree_rss_kb);
+        else
+            screen_put(&screen, y, x, attr, "%s %s", node->collapsed ? "[+]" : "[-]", tree_name(&tree, id));
     }
-    fclose(fp);
-    unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
-    if (sscanf(buffer, "cpu  %llu %llu %llu %llu %llu %llu %llu %llu",
-               &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal) < 8)
-        return 0;
-    return user + nice + system + idle + iowait + irq + softirq + steal;
 }
 
-void update_details_recursive(ProcessNode *node, unsigned long long global_delta) {
-    if (!node) return;
-    if (node->pid > 0) {
-        char path[256];
-        char mem[64] = "N/A";
-        unsigned long utime = 0, stime = 0;
-        snprintf(path, sizeof(path), "/proc/%d/status", node->pid);
-        FILE *fp = fopen(path, "r");
-        if (fp) {
-            char line[256];
-            while (fgets(line, sizeof(line), fp)) {
-                if (strncmp(line, "VmRSS:", 6) == 0) {
-                    sscanf(line, "VmRSS:%63s", mem);
-                    break;
-                }
-            }
-            fclose(fp);
-        }
-        snprintf(path, sizeof(path), "/proc/%d/stat", node->pid);
-        fp = fopen(path, "r");
-        unsigned long current_proc_time = 0;
-        if (fp) {
-            char buffer[1024];
-            if (fgets(buffer, sizeof(buffer), fp)) {
-                char comm[256];
-                if (sscanf(buffer,
-                           "%*d (%[^)]) %*c %*d %*d %*d %*d %*d %*u %*lu %*lu %*lu %*lu %lu %lu",
-                           comm, &utime, &stime) == 3) {
-                    current_proc_time = utime + stime;
-                }
-            }
-            fclose(fp);
-        }
-        if (node->prev_cpu_time == 0) {
-            node->cpu_usage = 0.0;
-        } else {
-            unsigned long delta_proc = current_proc_time - node->prev_cpu_time;
-            node->cpu_usage = (global_delta > 0) ? ((double)delta_proc / (double)global_delta * 100.0) : 0.0;
-        }
-        node->prev_cpu_time = current_proc_time;
-        snprintf(node->details, sizeof(node->details),
-                 "Process: %s (PID: %d)\nMemory Usage: %s\nCPU Usage: %.2f%%",
-                 node->name, node->pid, mem, node->cpu_usage);
+/*
+ * Ranks just enough processes to cover everything up to the bottom of
+ * the screen; scroll_offset never exceeds selected_index.
+ */
+void rank_processes(const StatsBuffer *stats, uint32_t max_rows) {
+    uint32_t k = selected_index + max_rows;
+    if (k > ranked_cap) {
+        uint32_t *grown = realloc(ranked, k * sizeof(uint32_t));
+        if (!grown) return;
+        ranked = grown;
+        ranked_cap = k;
     }
-    update_details_recursive(node->child, global_delta);
-    update_details_recursive(node->next, global_delta);
+    ranked_count = rank_top(&tree, stats, rank_key, k, ranked, &ranked_total);
 }
 
-void* update_thread_func(void *arg) {
-    unsigned long long global_cpu_prev = get_global_cpu_time();
-    while (1) {
-        sleep(2);
-        unsigned long long global_cpu_now = get_global_cpu_time();
-        unsigned long long global_delta = (global_cpu_now > global_cpu_prev) ? (global_cpu_now - global_cpu_prev) : 1;
-        global_cpu_prev = global_cpu_now;
-        update_details_recursive(head, global_delta);
+void render_ranked(const StatsBuffer *stats) {
+    int max_rows = LINES - 4;
+    int track = reserve_drawn(max_rows);
+    for (int y = 0; y < max_rows && scroll_offset + y < ranked_count; y++) {
+        uint32_t id = ranked[scroll_offset + y];
+        const ProcStats *st = sampler_lookup(stats, &tree, id);
+        int attr = scroll_offset + y == selected_index ? A_REVERSE : 0;
+        if (track)
+            drawn_ids[drawn_count++] = id;
+        if (st)
+            screen_put(&screen, y, 2, attr, "%7d  %-16s %7.2f%%  %10llu kB", tree.nodes[id].pid,
+                       tree_name(&tree, id), st->cpu_usage, (unsigned long long)st->rss_kb);
+        else
+            screen_put(&screen, y, 2, attr, "%7d  %-16s %8s  %13s", tree.nodes[id].pid,
+                       tree_name(&tree, id), "N/A", "N/A");
     }
-    return NULL;
 }
 
-void load_process_tree() {
-    FILE *file = fopen("/proc/process_tree", "r");
-    if (!file) {
-        perror("Failed to open /proc/process_tree");
-        return;
-    }
-    char line[256];
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\n")] = 0;
-        add_process_node(line);
-    }
-    fclose(file);
+void set_view(int v, int key) {
+    view = v;
+    rank_key = key;
+    selected_index = 0;
+    scroll_offset = 0;
+    drawn_scroll = 0;
 }
 
-void render_visible_tree() {
-    int max_rows = LINES - 4; 
-    for (int i = scroll_offset; i < visible_count && i < scroll_offset + max_rows; i++) {
-        ProcessNode *node = visible_nodes[i];
-        int x = 2 + node->depth * 4;
-        int y = i - scroll_offset;
-        if (i == selected_index)
-            attron(A_REVERSE);
-        mvprintw(y, x, "%s %s", node->collapsed ? "[+]" : "[-]", node->name);
-        if (i == selected_index)
-            attroff(A_REVERSE);
+/* Details are only ever formatted for the selected row */
+void format_details(const StatsBuffer *stats, uint32_t id, char *details, size_t size) {
+    const ProcStats *st = sampler_lookup(stats, &tree, id);
+    int len = snprintf(details, size, "Process: %s (PID: %d)\n", tree_name(&tree, id), tree.nodes[id].pid);
+    if (st)
+        len += snprintf(details + len, size - len, "Memory Usage: %llu kB\nCPU Usage: %.2f%%",
+                        (unsigned long long)st->rss_kb, st->cpu_usage);
+    else
+        len += snprintf(details + len, size - len, "Memory Usage: N/A\nCPU Usage: N/A");
+    if (st && (st->flags & STAT_THREADS))
+        snprintf(details + len, size - len, "\nThreads: %u\nState: %c", st->nr_threads, st->state);
+}
+
+/* Sampling mode and what it costs the host, refreshed at most once a second */
+void render_sampler_status(int row) {
+    double now = now_seconds();
+    if (now - last_counters_at >= 1.0) {
+        SamplerCounters c;
+        sampler_counters(&c);
+        if (last_counters_at > 0) {
+            double span = now - last_counters_at;
+            reads_per_sec[0] = (c.visible_reads - last_counters.visible_reads) / span;
+            reads_per_sec[1] = (c.background_reads - last_counters.background_reads) / span;
+            reads_per_sec[2] = (c.bulk_reads - last_counters.bulk_reads) / span;
+        }
+        last_counters = c;
+        last_counters_at = now;
     }
+    static const char *rank_names[] = { "cpu", "mem", "pid", "name" };
+    char exited[96] = "";
+    const ExitRecord *last = &sources.last_exit;
+    if (sources.exits_seen > 0)
+        snprintf(exited, sizeof(exited), "   exits: %llu, last %s [%d] %.1f ms cpu %llu kB peak",
+                 sources.exits_seen, last->comm, last->pid, last->cpu_ns / 1e6,
+                 (unsigned long long)last->peak_rss_kb);
+    screen_put(&screen, row, 2, 0,
+               "%s%-4s [v] sampling: %s   /proc reads/s: visible %.0f  background %.0f  bulk %.0f   tty: %llu B"
+               "   events: %s%s",
+               view == VIEW_TREE ? "[t]ree" : "top by ", view == VIEW_TREE ? "" : rank_names[rank_key],
+               sampler_mode() == SAMPLE_VIEWPORT ? "viewport" : "all",
+               reads_per_sec[0], reads_per_sec[1], reads_per_sec[2], screen.bytes_frame,
+               event_sources_name(&sources), exited);
 }
 
-void render_details(const char *details, int start_row) {
+void render_details(const StatsBuffer *stats, uint32_t id, int start_row) {
     char details_copy[512];
-    strncpy(details_copy, details, sizeof(details_copy));
-    details_copy[sizeof(details_copy)-1] = '\0';
+    format_details(stats, id, details_copy, sizeof(details_copy));
     char *line = strtok(details_copy, "\n");
     int row = start_row;
     while (line != NULL && row < LINES) {
-        mvprintw(row++, 2, "%s", line);
+        screen_put(&screen, row++, 2, 0, "%s", line);
         line = strtok(NULL, "\n");
     }
 }
 
-int main() {
-    initscr();
+volatile sig_atomic_t batch_stop = 0;
+
+void stop_batch(int sig) {
+    batch_stop = 1;
+}
+
+/* Streams one frame per sweep until count frames, a signal, or a write error */
+int run_batch(FILE *out, int format, unsigned interval_ms, unsigned long count) {
+    signal(SIGINT, stop_batch);
+    signal(SIGTERM, stop_batch);
+    signal(SIGPIPE, SIG_IGN);
+
+    tree_init(&tree);
+    load_process_tree();
+    sampler_set_interval(interval_ms);
+    if (sampler_start(&tree, &tree_lock, sysconf(_SC_NPROCESSORS_ONLN)) < 0) {
+        fprintf(stderr, "Error creating update thread\n");
+        return 1;
+    }
+
+    batch_write_header(out, format);
+    unsigned long long seen = 0;
+    unsigned long frames = 0;
+    int status = 0;
+    while (!batch_stop && (count == 0 || frames < count)) {
+        unsigned long long sweep = sampler_wait(seen, 500);
+        if (sweep == seen) continue;
+        seen = sweep;
+
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        pthread_mutex_lock(&tree_lock);
+        apply_tree_events();
+        uint64_t ts_ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+        int n, err = 0;
+        while (err == 0 && (n = event_sources_read_exits(&sources)) > 0)
+            err = batch_write_exits(out, format, sources.exits, n, ts_ms);
+        const StatsBuffer *stats = sampler_acquire();
+        if (err == 0)
+            err = batch_write_frame(out, format, &tree, stats, ts_ms);
+        sampler_release(stats);
+        pthread_mutex_unlock(&tree_lock);
+        if (err < 0) {
+            status = 1;
+            break;
+        }
+        frames++;
+    }
+
+    sampler_stop();
+    event_sources_close(&sources);
+    tree_free(&tree);
+    return status;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-b] [-f csv|ndjson|bin] [-i seconds] [-n frames] [-o file]\n"
+            "  -b  batch mode: no UI, stream one frame per sample to stdout or -o\n"
+            "  -f  output format (default csv; implies -b)\n"
+            "  -i  sample interval in seconds, fractions allowed (default 2)\n"
+            "  -n  stop after this many frames (default: run until interrupted)\n"
+            "  -o  write frames to file instead of stdout (implies -b)\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    int batch = 0, format = BATCH_CSV, opt;
+    unsigned interval_ms = 0;
+    unsigned long count = 0;
+    const char *out_path = NULL;
+    while ((opt = getopt(argc, argv, "bf:i:n:o:h")) != -1) {
+        switch (opt) {
+            case 'b':
+                batch = 1;
+                break;
+            case 'f':
+                batch = 1;
+                format = batch_format(optarg);
+                if (format < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'i': {
+                /* at least a millisecond, and small enough for interval_ms; rejects NaN too */
+                char *end;
+                double seconds = strtod(optarg, &end);
+                if (end == optarg || *end || !(seconds >= 0.001 && seconds <= UINT_MAX / 1000)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                interval_ms = (unsigned)(seconds * 1000 + 0.5);
+                break;
+            }
+            case 'n': {
+                /* digits only: strtoul would skip blanks and take "-1" as a huge count */
+                char *end;
+                errno = 0;
+                count = strtoul(optarg, &end, 10);
+                if (optarg[0] < '0' || optarg[0] > '9' || *end || errno == ERANGE || count == 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            }
+            case 'o':
+                batch = 1;
+                out_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (batch) {
+        FILE *out = stdout;
+        if (out_path && !(out = fopen(out_path, format == BATCH_BINARY ? "wb" : "w"))) {
+            perror(out_path);
+            return 1;
+        }
+        int status = run_batch(out, format, interval_ms, count);
+        if (out != stdout)
+            fclose(out);
+        return status;
+    }
+    sampler_set_interval(interval_ms);
+
+    if (screen_open(&screen) < 0) {
+        fprintf(stderr, "Failed to initialise the terminal\n");
+        exit(EXIT_FAILURE);
+    }
     noecho();
     cbreak();
     keypad(stdscr, TRUE);
+    /* short tick so a finished sweep shows up promptly, not on the next key */
+    timeout(250);
 
+    tree_init(&tree);
     load_process_tree();
-    flatten_tree();
 
     selected_index = 0;
     scroll_offset = 0;
 
-    pthread_t update_thread;
-    if (pthread_create(&update_thread, NULL, update_thread_func, NULL)) {
-        endwin();
+    if (sampler_start(&tree, &tree_lock, sysconf(_SC_NPROCESSORS_ONLN)) < 0) {
+        screen_close(&screen);
         fprintf(stderr, "Error creating update thread\n");
         exit(EXIT_FAILURE);
     }
 
     int ch;
     while ((ch = getch()) != 'q') {
-        int max_rows = LINES - 4;
+        uint32_t max_rows = LINES - 4;
         switch (ch) {
             case KEY_UP:
                 if (selected_index > 0)
                     selected_index--;
                 break;
             case KEY_DOWN:
-                if (selected_index < visible_count - 1)
+                if (selected_index + 1 < view_rows())
                     selected_index++;
                 break;
-            case '\n': 
-                if (selected_index < visible_count)
-                    visible_nodes[selected_index]->collapsed = !visible_nodes[selected_index]->collapsed;
+            case 't':
+                set_view(VIEW_TREE, rank_key);
+                break;
+            case 'c':
+                set_view(VIEW_RANKED, RANK_CPU);
+                break;
+            case 'm':
+                set_view(VIEW_RANKED, RANK_RSS);
+                break;
+            case 'p':
+                set_view(VIEW_RANKED, RANK_PID);
+                break;
+            case 'n':
+                set_view(VIEW_RANKED, RANK_NAME);
+                break;
+            case KEY_RESIZE:
+                screen_resize(&screen);
                 break;
+            case 'v':
+                sampler_set_mode(sampler_mode() == SAMPLE_VIEWPORT ? SAMPLE_ALL : SAMPLE_VIEWPORT);
+                break;
+            case '\n': {
+                uint32_t id = view == VIEW_TREE ? tree_visible_at(&tree, selected_index) : NODE_NONE;
+                if (id != NODE_NONE)
+                    tree_set_collapsed(&tree, id, !tree.nodes[id].collapsed);
+                break;
+            }
+            case ERR: {
+                int changed = sampler_sweep() != drawn_sweep;
+                if (pthread_mutex_trylock(&tree_lock) == 0) {
+                    changed |= apply_tree_events();
+                    pthread_mutex_unlock(&tree_lock);
+                }
+                while (event_sources_read_exits(&sources) == EXIT_BATCH)
+                    changed = 1;
+                changed |= sources.exits_seen != drawn_exits;
+                if (!changed)
+                    continue;
+                break;
+            }
             default:
                 break;
         }
 
-        flatten_tree();
+        const StatsBuffer *stats = sampler_acquire();
+        drawn_sweep = stats ? stats->sweep : 0;
+        sampler_roll_up(&tree, stats);
+        if (view == VIEW_RANKED)
+            rank_processes(stats, max_rows);
+
+        if (selected_index >= view_rows())
+            selected_index = view_rows() > 0 ? view_rows() - 1 : 0;
         if (selected_index < scroll_offset)
             scroll_offset = selected_index;
         else if (selected_index >= scroll_offset + max_rows)
             scroll_offset = selected_index - max_rows + 1;
 
-        clear();
-        render_visible_tree();
-        if (selected_index < visible_count) {
-            render_details(visible_nodes[selected_index]->details, max_rows + 1);
+        /* the tree band scrolls on the terminal; only exposed rows are redrawn */
+        if (scroll_offset != drawn_scroll)
+            screen_scroll(&screen, 0, max_rows - 1, (int)(scroll_offset - drawn_scroll));
+        drawn_scroll = scroll_offset;
+
+        uint32_t selected;
+        if (view == VIEW_TREE) {
+            render_visible_tree();
+            selected = tree_visible_at(&tree, selected_index);
+        } else {
+            render_ranked(stats);
+            selected = selected_index < ranked_count ? ranked[selected_index] : NODE_NONE;
+        }
+        if (selected != NODE_NONE) {
+            render_details(stats, selected, max_rows + 1);
         }
-        refresh();
+        sampler_release(stats);
+        render_sampler_status(max_rows);
+        drawn_exits = sources.exits_seen;
+        screen_flush(&screen);
+        sampler_set_viewport(drawn_ids, drawn_count);
     }
 
-    pthread_cancel(update_thread);
-    pthread_join(update_thread, NULL);
-    endwin();
-    free_process_nodes(head);
+    sampler_stop();
+    screen_close(&screen);
+    event_sources_close(&sources);
+    tree_free(&tree);
+    free(drawn_ids);
+    free(ranked);
     return 0;
 }
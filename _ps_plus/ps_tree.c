@@ -0,0 +1,679 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#include "ps_tree.h"
+
+#define BIN_READ_CHUNK (1 << 20)
+#define EVENT_BATCH 512
+#define NAME_NONE UINT32_MAX     /* intern_name() ran out of memory */
+
+void tree_init(ProcessTree *t) {
+    memset(t, 0, sizeof(*t));
+    tree_reset(t);
+}
+
+void tree_reset(ProcessTree *t) {
+    t->count = 0;
+    t->free_list = NODE_NONE;
+    t->root = NODE_NONE;
+    t->root_last = NODE_NONE;
+    t->visible_rows = 0;
+    t->names_len = 0;
+    t->name_table_used = 0;
+    t->generation = 0;
+    if (t->name_table)
+        memset(t->name_table, 0, t->name_table_size * sizeof(uint32_t));
+    memset(t->pid_table, 0xff, sizeof(t->pid_table));
+}
+
+void tree_free(ProcessTree *t) {
+    free(t->nodes);
+    free(t->names);
+    free(t->name_table);
+    tree_init(t);
+}
+
+const char *tree_name(const ProcessTree *t, uint32_t id) {
+    return t->names + t->nodes[id].name;
+}
+
+static uint32_t hash_name(const char *name, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    return h;
+}
+
+static int grow_name_table(ProcessTree *t) {
+    uint32_t size = t->name_table_size ? t->name_table_size * 2 : 1024;
+    uint32_t *table = calloc(size, sizeof(uint32_t));
+    if (!table) return -1;
+    for (uint32_t i = 0; i < t->name_table_size; i++) {
+        uint32_t entry = t->name_table[i];
+        if (!entry) continue;
+        const char *name = t->names + entry - 1;
+        uint32_t slot = hash_name(name, strlen(name)) & (size - 1);
+        while (table[slot])
+            slot = (slot + 1) & (size - 1);
+        table[slot] = entry;
+    }
+    free(t->name_table);
+    t->name_table = table;
+    t->name_table_size = size;
+    return 0;
+}
+
+/* Returns the pool offset of name, adding it on first use, or NAME_NONE without memory */
+static uint32_t intern_name(ProcessTree *t, const char *name, size_t len) {
+    if ((t->name_table_used + 1) * 2 > t->name_table_size && grow_name_table(t) < 0)
+        return NAME_NONE;
+
+    uint32_t mask = t->name_table_size - 1;
+    uint32_t slot = hash_name(name, len) & mask;
+    while (t->name_table[slot]) {
+        const char *existing = t->names + t->name_table[slot] - 1;
+        if (strncmp(existing, name, len) == 0 && existing[len] == '\0')
+            return t->name_table[slot] - 1;
+        slot = (slot + 1) & mask;
+    }
+
+    if (t->names_len + len + 1 > t->names_cap) {
+        uint32_t cap = t->names_cap ? t->names_cap : 4096;
+        while (t->names_len + len + 1 > cap)
+            cap *= 2;
+        char *names = realloc(t->names, cap);
+        if (!names) return NAME_NONE;
+        t->names = names;
+        t->names_cap = cap;
+    }
+    uint32_t offset = t->names_len;
+    memcpy(t->names + offset, name, len);
+    t->names[offset + len] = '\0';
+    t->names_len += len + 1;
+    t->name_table[slot] = offset + 1;
+    t->name_table_used++;
+    return offset;
+}
+
+uint32_t tree_find_pid(const ProcessTree *t, int pid) {
+    uint32_t id = t->pid_table[pid & (PID_TABLE_SIZE - 1)];
+    while (id != NODE_NONE && t->nodes[id].pid != pid)
+        id = t->nodes[id].hash_next;
+    return id;
+}
+
+static void unhash_pid(ProcessTree *t, uint32_t id) {
+    uint32_t *link = &t->pid_table[t->nodes[id].pid & (PID_TABLE_SIZE - 1)];
+    while (*link != NODE_NONE && *link != id)
+        link = &t->nodes[*link].hash_next;
+    if (*link != NODE_NONE)
+        *link = t->nodes[id].hash_next;
+}
+
+static uint32_t *child_link(ProcessTree *t, uint32_t parent) {
+    return parent == NODE_NONE ? &t->root : &t->nodes[parent].child;
+}
+
+static uint32_t *last_child_link(ProcessTree *t, uint32_t parent) {
+    return parent == NODE_NONE ? &t->root_last : &t->nodes[parent].last_child;
+}
+
+static uint32_t node_rows(const ProcessTree *t, uint32_t id) {
+    return 1 + (t->nodes[id].collapsed ? 0 : t->nodes[id].child_rows);
+}
+
+/* Adds delta visible rows below parent, stopping at the first collapsed ancestor */
+static void add_rows(ProcessTree *t, uint32_t parent, int delta) {
+    for (uint32_t p = parent; p != NODE_NONE; p = t->nodes[p].parent) {
+        t->nodes[p].child_rows += delta;
+        if (t->nodes[p].collapsed)
+            return;
+    }
+    t->visible_rows += delta;
+}
+
+/* Unsigned wrap-around makes negative deltas come out right */
+static void add_totals(ProcessTree *t, uint32_t from, uint64_t rss_delta, uint64_t cpu_delta) {
+    for (uint32_t p = from; p != NODE_NONE; p = t->nodes[p].parent) {
+        t->nodes[p].subtree_rss_kb += rss_delta;
+        t->nodes[p].subtree_cpu_centi += cpu_delta;
+    }
+}
+
+/* Siblings are doubly linked with a tail per parent, so both ends are O(1) */
+static void append_child(ProcessTree *t, uint32_t parent, uint32_t id) {
+    uint32_t *last = last_child_link(t, parent);
+    ProcessNode *node = &t->nodes[id];
+    node->parent = parent;
+    node->next = NODE_NONE;
+    node->prev = *last;
+    if (*last != NODE_NONE)
+        t->nodes[*last].next = id;
+    else
+        *child_link(t, parent) = id;
+    *last = id;
+}
+
+static void link_child(ProcessTree *t, uint32_t parent, uint32_t id) {
+    append_child(t, parent, id);
+    add_rows(t, parent, node_rows(t, id));
+    add_totals(t, parent, t->nodes[id].subtree_rss_kb, t->nodes[id].subtree_cpu_centi);
+}
+
+/*
+ * Row counts for a freshly loaded tree in one pass. Loaders append each
+ * node after its parent, so walking the arena backwards sees every child
+ * before its parent.
+ */
+static void recount_rows(ProcessTree *t) {
+    t->visible_rows = 0;
+    for (uint32_t id = 0; id < t->count; id++)
+        t->nodes[id].child_rows = 0;
+    for (uint32_t id = t->count; id-- > 0;) {
+        uint32_t parent = t->nodes[id].parent;
+        if (parent == NODE_NONE)
+            t->visible_rows += node_rows(t, id);
+        else
+            t->nodes[parent].child_rows += node_rows(t, id);
+    }
+}
+
+static void unlink_child(ProcessTree *t, uint32_t id) {
+    ProcessNode *node = &t->nodes[id];
+    add_rows(t, node->parent, -(int)node_rows(t, id));
+    add_totals(t, node->parent, -node->subtree_rss_kb, -node->subtree_cpu_centi);
+    if (node->prev != NODE_NONE)
+        t->nodes[node->prev].next = node->next;
+    else
+        *child_link(t, node->parent) = node->next;
+    if (node->next != NODE_NONE)
+        t->nodes[node->next].prev = node->prev;
+    else
+        *last_child_link(t, node->parent) = node->prev;
+    node->next = NODE_NONE;
+    node->prev = NODE_NONE;
+    node->parent = NODE_NONE;
+}
+
+/* Next node in pre-order, not leaving the subtree rooted at stop */
+uint32_t tree_next_preorder(const ProcessTree *t, uint32_t id, uint32_t stop) {
+    if (t->nodes[id].child != NODE_NONE)
+        return t->nodes[id].child;
+    while (id != stop && id != NODE_NONE) {
+        if (t->nodes[id].next != NODE_NONE)
+            return t->nodes[id].next;
+        id = t->nodes[id].parent;
+    }
+    return NODE_NONE;
+}
+
+void tree_set_collapsed(ProcessTree *t, uint32_t id, int collapsed) {
+    if (!t->nodes[id].collapsed == !collapsed) return;
+    int before = node_rows(t, id);
+    t->nodes[id].collapsed = collapsed ? 1 : 0;
+    add_rows(t, t->nodes[id].parent, (int)node_rows(t, id) - before);
+}
+
+/* Only the difference from the node's previous sample travels up the tree */
+void tree_set_sample(ProcessTree *t, uint32_t id, uint64_t rss_kb, uint32_t cpu_centi) {
+    ProcessNode *node = &t->nodes[id];
+    uint64_t rss_delta = rss_kb - node->rss_kb;
+    uint64_t cpu_delta = (uint64_t)cpu_centi - node->cpu_centi;
+    if (!rss_delta && !cpu_delta) return;
+    node->rss_kb = rss_kb;
+    node->cpu_centi = cpu_centi;
+    add_totals(t, id, rss_delta, cpu_delta);
+}
+
+/* Descends by subtree row counts: O(depth * siblings), not O(tree) */
+uint32_t tree_visible_at(const ProcessTree *t, uint32_t row) {
+    uint32_t id = t->root;
+    while (id != NODE_NONE) {
+        uint32_t rows = node_rows(t, id);
+        if (row >= rows) {
+            row -= rows;
+            id = t->nodes[id].next;
+        } else if (row == 0) {
+            return id;
+        } else {
+            row--;
+            id = t->nodes[id].child;
+        }
+    }
+    return NODE_NONE;
+}
+
+uint32_t tree_visible_next(const ProcessTree *t, uint32_t id) {
+    if (!t->nodes[id].collapsed && t->nodes[id].child != NODE_NONE)
+        return t->nodes[id].child;
+    while (id != NODE_NONE) {
+        if (t->nodes[id].next != NODE_NONE)
+            return t->nodes[id].next;
+        id = t->nodes[id].parent;
+    }
+    return NODE_NONE;
+}
+
+static void set_subtree_depth(ProcessTree *t, uint32_t id, int depth) {
+    int base = t->nodes[id].depth;
+    for (uint32_t n = id; n != NODE_NONE; n = tree_next_preorder(t, n, id))
+        t->nodes[n].depth = t->nodes[n].depth - base + depth;
+}
+
+/* Moves id and its subtree under parent; rows and totals move along through unlink/link */
+static void move_node(ProcessTree *t, uint32_t id, uint32_t parent) {
+    unlink_child(t, id);
+    link_child(t, parent, id);
+    set_subtree_depth(t, id, parent == NODE_NONE ? 0 : t->nodes[parent].depth + 1);
+}
+
+static int is_ancestor(const ProcessTree *t, uint32_t ancestor, uint32_t id) {
+    for (; id != NODE_NONE; id = t->nodes[id].parent)
+        if (id == ancestor)
+            return 1;
+    return 0;
+}
+
+static uint32_t alloc_node(ProcessTree *t) {
+    if (t->free_list != NODE_NONE) {
+        uint32_t id = t->free_list;
+        t->free_list = t->nodes[id].next;
+        return id;
+    }
+    if (t->count == t->cap) {
+        uint32_t cap = t->cap ? t->cap * 2 : 1024;
+        ProcessNode *nodes = realloc(t->nodes, cap * sizeof(ProcessNode));
+        if (!nodes) return NODE_NONE;
+        t->nodes = nodes;
+        t->cap = cap;
+    }
+    return t->count++;
+}
+
+static uint32_t add_node(ProcessTree *t, int pid, const char *name, size_t name_len,
+                         uint32_t parent, int count_rows) {
+    uint32_t name_offset = intern_name(t, name, name_len);
+    if (name_offset == NAME_NONE) return NODE_NONE;
+    uint32_t id = alloc_node(t);
+    if (id == NODE_NONE) return NODE_NONE;
+
+    ProcessNode *node = &t->nodes[id];
+    memset(node, 0, sizeof(*node));
+    node->pid = pid;
+    node->name = name_offset;
+    node->child = NODE_NONE;
+    node->last_child = NODE_NONE;
+    node->depth = parent == NODE_NONE ? 0 : t->nodes[parent].depth + 1;
+    node->flags = NODE_LIVE;
+    if (count_rows)
+        link_child(t, parent, id);
+    else
+        append_child(t, parent, id);
+
+    uint32_t *bucket = &t->pid_table[pid & (PID_TABLE_SIZE - 1)];
+    node->hash_next = *bucket;
+    *bucket = id;
+    return id;
+}
+
+uint32_t tree_add(ProcessTree *t, int pid, const char *name, size_t name_len, uint32_t parent) {
+    return add_node(t, pid, name, name_len, parent, 1);
+}
+
+/* Children must already have been moved elsewhere */
+void tree_remove(ProcessTree *t, uint32_t id) {
+    unlink_child(t, id);
+    unhash_pid(t, id);
+    t->nodes[id].flags = 0;
+    t->nodes[id].next = t->free_list;
+    t->free_list = id;
+}
+
+char *read_whole_file(const char *path, size_t *len_out) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    size_t cap = BIN_READ_CHUNK, len = 0;
+    char *buf = malloc(cap);
+    ssize_t n;
+    while (buf && (n = read(fd, buf + len, cap - len)) > 0) {
+        len += n;
+        if (len == cap) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) {
+                free(buf);
+                buf = NULL;
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+    }
+    close(fd);
+    *len_out = len;
+    return buf;
+}
+
+/* Returns the record array inside buf, or NULL if the header doesn't match */
+const struct pt_record *parse_tree_records(const char *buf, size_t len, struct pt_header *hdr, size_t *count) {
+    if (len < sizeof(*hdr)) return NULL;
+    memcpy(hdr, buf, sizeof(*hdr));
+    if (hdr->magic != PT_MAGIC || hdr->version != PT_VERSION ||
+        hdr->record_size != sizeof(struct pt_record) || hdr->header_size > len)
+        return NULL;
+    *count = (len - hdr->header_size) / hdr->record_size;
+    return (const struct pt_record *)(buf + hdr->header_size);
+}
+
+/* Parent-by-depth stack for the pre-order loaders, grown on demand */
+typedef struct DepthStack {
+    uint32_t *ids;
+    size_t cap;
+} DepthStack;
+
+static int depth_stack_set(DepthStack *s, size_t depth, uint32_t id) {
+    if (depth >= s->cap) {
+        size_t cap = s->cap ? s->cap : 64;
+        while (depth >= cap)
+            cap *= 2;
+        uint32_t *ids = realloc(s->ids, cap * sizeof(uint32_t));
+        if (!ids) return -1;
+        memset(ids + s->cap, 0xff, (cap - s->cap) * sizeof(uint32_t));
+        s->ids = ids;
+        s->cap = cap;
+    }
+    s->ids[depth] = id;
+    return 0;
+}
+
+static uint32_t depth_stack_parent(const DepthStack *s, size_t depth) {
+    return depth > 0 && depth - 1 < s->cap ? s->ids[depth - 1] : NODE_NONE;
+}
+
+int tree_load_bin(ProcessTree *t, const char *path) {
+    size_t len, count;
+    struct pt_header hdr;
+    char *buf = read_whole_file(path, &len);
+    if (!buf) return -1;
+    const struct pt_record *records = parse_tree_records(buf, len, &hdr, &count);
+    if (!records) {
+        free(buf);
+        return -1;
+    }
+
+    DepthStack stack = {0};
+    for (size_t i = 0; i < count; i++) {
+        const struct pt_record *rec = &records[i];
+        uint32_t parent = depth_stack_parent(&stack, rec->depth);
+        uint32_t id = add_node(t, rec->pid, rec->comm, strnlen(rec->comm, PT_COMM_LEN), parent, 0);
+        if (id == NODE_NONE || depth_stack_set(&stack, rec->depth, id) < 0) {
+            free(stack.ids);
+            free(buf);
+            return -1;
+        }
+    }
+    recount_rows(t);
+    t->generation = hdr.generation;
+    free(stack.ids);
+    free(buf);
+    return 0;
+}
+
+int tree_load_text(ProcessTree *t, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    DepthStack stack = {0};
+    char *line = NULL;
+    size_t line_cap = 0;
+    int err = 0;
+    while (!err && getline(&line, &line_cap, file) > 0) {
+        line[strcspn(line, "\n")] = 0;
+        size_t space_count = 0;
+        while (line[space_count] == ' ') space_count++;
+        size_t depth = space_count / 2;
+
+        char proc_name[256] = {0};
+        int pid = -1;
+        if (sscanf(line + space_count, "%255s [%d]", proc_name, &pid) != 2)
+            strncpy(proc_name, line + space_count, 255);
+
+        uint32_t id = add_node(t, pid, proc_name, strlen(proc_name), depth_stack_parent(&stack, depth), 0);
+        err = id == NODE_NONE || depth_stack_set(&stack, depth, id) < 0;
+    }
+    if (!err)
+        recount_rows(t);
+    free(line);
+    free(stack.ids);
+    fclose(file);
+    return err ? -1 : 0;
+}
+
+typedef struct ProcEntry {
+    int pid;
+    int ppid;
+    int parent;             /* index into the sorted entries, or -1 */
+    int child;
+    int last_child;
+    int next;
+    uint32_t id;
+    char comm[PT_COMM_LEN + 1];
+} ProcEntry;
+
+static int compare_entry_pid(const void *a, const void *b) {
+    const ProcEntry *x = a, *y = b;
+    return (x->pid > y->pid) - (x->pid < y->pid);
+}
+
+/* Reads one /proc/<pid>/stat into e; the comm sits between '(' and the last ')' */
+static int read_proc_entry(int pid, ProcEntry *e) {
+    char path[64], buf[512];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+
+    char *open_paren = strchr(buf, '('), *close_paren = strrchr(buf, ')');
+    if (!open_paren || !close_paren || close_paren < open_paren ||
+        sscanf(close_paren + 2, "%*c %d", &e->ppid) != 1)
+        return -1;
+    size_t len = close_paren - open_paren - 1;
+    if (len > PT_COMM_LEN) len = PT_COMM_LEN;
+    memcpy(e->comm, open_paren + 1, len);
+    e->comm[len] = '\0';
+    e->pid = pid;
+    return 0;
+}
+
+/*
+ * Builds the tree from /proc alone, for hosts without either module.
+ * Processes are linked to their parents by index after one directory
+ * scan, then added in pre-order so the arena keeps the loaders' layout.
+ */
+int tree_load_proc(ProcessTree *t) {
+    DIR *dir = opendir("/proc");
+    if (!dir) return -1;
+
+    ProcEntry *entries = NULL;
+    size_t count = 0, cap = 0;
+    struct dirent *de;
+    while ((de = readdir(dir))) {
+        int pid = atoi(de->d_name);
+        if (pid <= 0) continue;
+        if (count == cap) {
+            size_t grown_cap = cap ? cap * 2 : 1024;
+            ProcEntry *grown = realloc(entries, grown_cap * sizeof(ProcEntry));
+            if (!grown) {
+                closedir(dir);
+                free(entries);
+                return -1;
+            }
+            entries = grown;
+            cap = grown_cap;
+        }
+        if (read_proc_entry(pid, &entries[count]) == 0)
+            count++;
+    }
+    closedir(dir);
+
+    qsort(entries, count, sizeof(ProcEntry), compare_entry_pid);
+    for (size_t i = 0; i < count; i++)
+        entries[i].child = entries[i].last_child = entries[i].next = -1;
+    for (size_t i = 0; i < count; i++) {
+        ProcEntry key = { .pid = entries[i].ppid };
+        ProcEntry *parent = entries[i].ppid > 0 && entries[i].ppid != entries[i].pid
+            ? bsearch(&key, entries, count, sizeof(ProcEntry), compare_entry_pid) : NULL;
+        entries[i].parent = parent ? parent - entries : -1;
+        if (!parent) continue;
+        if (parent->last_child >= 0)
+            entries[parent->last_child].next = i;
+        else
+            parent->child = i;
+        parent->last_child = i;
+    }
+
+    for (size_t root = 0; root < count; root++) {
+        if (entries[root].parent >= 0) continue;
+        int i = root;
+        for (;;) {
+            ProcEntry *e = &entries[i];
+            uint32_t parent = e->parent >= 0 ? entries[e->parent].id : NODE_NONE;
+            e->id = add_node(t, e->pid, e->comm, strlen(e->comm), parent, 0);
+            if (e->id == NODE_NONE) {
+                free(entries);
+                return -1;
+            }
+            if (e->child >= 0) {
+                i = e->child;
+                continue;
+            }
+            while (i != (int)root && entries[i].next < 0)
+                i = entries[i].parent;
+            if (i == (int)root) break;
+            i = entries[i].next;
+        }
+    }
+    recount_rows(t);
+    free(entries);
+    return 0;
+}
+
+/* Fills a freshly reset tree from the best source available */
+int tree_load(ProcessTree *t) {
+    if (tree_load_bin(t, "/proc/" PT_PROC_BIN) == 0)
+        return 0;
+    tree_reset(t);
+    if (tree_load_text(t, "/proc/process_tree") == 0)
+        return 0;
+    tree_reset(t);
+    return tree_load_proc(t);
+}
+
+/* Returns 1 if pid was added, 0 if it was already known */
+int tree_fork(ProcessTree *t, int pid, int ppid, const char *name, size_t name_len) {
+    if (tree_find_pid(t, pid) != NODE_NONE)
+        return 0;
+    return tree_add(t, pid, name, name_len, tree_find_pid(t, ppid)) != NODE_NONE;
+}
+
+/* Without memory for the new name the old one stays */
+void tree_rename(ProcessTree *t, uint32_t id, const char *name, size_t name_len) {
+    uint32_t name_offset = intern_name(t, name, name_len);
+    if (name_offset != NAME_NONE)
+        t->nodes[id].name = name_offset;
+}
+
+/*
+ * Returns 1 if pid was removed. The kernel hands orphans to init (or a
+ * subreaper); pid 1 is the best guess here.
+ */
+int tree_exit(ProcessTree *t, int pid) {
+    uint32_t id = tree_find_pid(t, pid);
+    if (id == NODE_NONE) return 0;
+    uint32_t reaper = tree_find_pid(t, 1);
+    if (reaper == NODE_NONE || reaper == id)
+        reaper = t->nodes[id].parent;
+    while (t->nodes[id].child != NODE_NONE)
+        move_node(t, t->nodes[id].child, reaper);
+    tree_remove(t, id);
+    return 1;
+}
+
+/*
+ * Brings t in line with a freshly loaded snapshot without rebuilding it,
+ * so node ids, collapse state and subtree totals survive a resync.
+ * Surviving processes move if their parent changed: reparented orphans,
+ * or a reused pid that belongs to another parent now. Returns 1 if t
+ * changed.
+ */
+int tree_sync(ProcessTree *t, const ProcessTree *fresh) {
+    int changed = 0;
+    for (uint32_t id = 0; id < t->count; id++) {
+        const ProcessNode *node = &t->nodes[id];
+        if ((node->flags & NODE_LIVE) && node->pid > 0 && tree_find_pid(fresh, node->pid) == NODE_NONE)
+            changed |= tree_exit(t, node->pid);
+    }
+    /* pre-order, so a new parent is in place before its children */
+    for (uint32_t id = fresh->root; id != NODE_NONE; id = tree_next_preorder(fresh, id, NODE_NONE)) {
+        const ProcessNode *node = &fresh->nodes[id];
+        const char *name = tree_name(fresh, id);
+        uint32_t have = tree_find_pid(t, node->pid);
+        int ppid = node->parent != NODE_NONE ? fresh->nodes[node->parent].pid : 0;
+        if (have == NODE_NONE) {
+            changed |= tree_fork(t, node->pid, ppid, name, strlen(name));
+            continue;
+        }
+        /* the new parent was placed earlier in this walk, so it can't sit below have */
+        uint32_t parent = node->parent != NODE_NONE ? tree_find_pid(t, ppid) : NODE_NONE;
+        if (t->nodes[have].parent != parent && !is_ancestor(t, have, parent)) {
+            move_node(t, have, parent);
+            changed = 1;
+        }
+        if (strcmp(tree_name(t, have), name) != 0) {
+            tree_rename(t, have, name, strlen(name));
+            changed = 1;
+        }
+    }
+    t->generation = fresh->generation;
+    return changed;
+}
+
+/*
+ * Applies everything the events file has queued since t->generation.
+ * Returns 1 if the tree changed, 0 if not, -1 if the events were lost
+ * and the caller has to reload the tree.
+ */
+int tree_apply_events(ProcessTree *t, int fd) {
+    static char buf[sizeof(struct pt_header) + EVENT_BATCH * sizeof(struct pt_event)];
+    int changed = 0;
+    ssize_t n;
+
+    while ((n = read(fd, buf, sizeof(buf))) >= (ssize_t)sizeof(struct pt_header)) {
+        struct pt_header hdr;
+        memcpy(&hdr, buf, sizeof(hdr));
+        if (hdr.magic != PT_EVENT_MAGIC || hdr.record_size != sizeof(struct pt_event))
+            break;
+        if (hdr.flags & PT_FLAG_OVERFLOW)
+            return -1;
+        size_t count = (n - hdr.header_size) / hdr.record_size;
+        for (size_t i = 0; i < count; i++) {
+            struct pt_event ev;
+            memcpy(&ev, buf + hdr.header_size + i * hdr.record_size, sizeof(ev));
+            if (ev.type == PT_EVENT_FORK)
+                tree_fork(t, ev.pid, ev.ppid, ev.comm, strnlen(ev.comm, PT_COMM_LEN));
+            else if (ev.type == PT_EVENT_EXIT)
+                tree_exit(t, ev.pid);
+        }
+        t->generation = hdr.generation;
+        changed |= count > 0;
+        if (count < EVENT_BATCH)
+            break;
+    }
+    return changed;
+}
@@ -0,0 +1,93 @@
+#ifndef PS_TREE_H
+#define PS_TREE_H
+
+/*
+ * Process tree held in one growable arena. Nodes refer to each other by
+ * 32-bit index, names live once each in an interned string pool, and
+ * resetting the tree just rewinds the counters.
+ *
+ * Every node also counts the visible rows below it (child_rows), kept up
+ * to date as nodes move or collapse, so the UI can find row N by descent
+ * instead of flattening the whole tree on every keypress.
+ *
+ * Subtree CPU and RSS totals follow the same pattern: tree_set_sample()
+ * pushes the change in one node's sample up its parent chain, and moving
+ * or removing a node carries its whole subtree total along.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "process_tree.h"
+
+#define NODE_NONE       UINT32_MAX
+#define PID_TABLE_SIZE  65536
+
+#define NODE_LIVE     0x1
+#define NODE_LEADER_EXITED  0x2   /* a zombie leader whose other threads still run */
+
+typedef struct ProcessNode {
+    int32_t pid;
+    uint32_t name;          /* offset into ProcessTree.names */
+    uint32_t parent;
+    uint32_t child;
+    uint32_t last_child;
+    uint32_t next;
+    uint32_t prev;
+    uint32_t hash_next;
+    uint32_t child_rows;    /* visible rows under this node if expanded */
+    uint32_t cpu_centi;     /* own cpu usage in hundredths of a percent */
+    uint16_t depth;
+    uint8_t collapsed;
+    uint8_t flags;
+    uint64_t rss_kb;        /* own RSS as last rolled up */
+    uint64_t subtree_rss_kb;        /* this node and every descendant */
+    uint64_t subtree_cpu_centi;
+} ProcessNode;
+
+typedef struct ProcessTree {
+    ProcessNode *nodes;
+    uint32_t count;
+    uint32_t cap;
+    uint32_t free_list;     /* removed slots, chained through next */
+    uint32_t root;
+    uint32_t root_last;
+    uint32_t visible_rows;
+    char *names;
+    uint32_t names_len;
+    uint32_t names_cap;
+    uint32_t *name_table;   /* open addressing, holds offset + 1 */
+    uint32_t name_table_size;
+    uint32_t name_table_used;
+    uint32_t pid_table[PID_TABLE_SIZE];
+    unsigned long long generation;
+} ProcessTree;
+
+void tree_init(ProcessTree *t);
+void tree_reset(ProcessTree *t);
+void tree_free(ProcessTree *t);
+
+const char *tree_name(const ProcessTree *t, uint32_t id);
+uint32_t tree_find_pid(const ProcessTree *t, int pid);
+uint32_t tree_add(ProcessTree *t, int pid, const char *name, size_t name_len, uint32_t parent);
+void tree_remove(ProcessTree *t, uint32_t id);
+int tree_fork(ProcessTree *t, int pid, int ppid, const char *name, size_t name_len);
+int tree_exit(ProcessTree *t, int pid);
+void tree_rename(ProcessTree *t, uint32_t id, const char *name, size_t name_len);
+uint32_t tree_next_preorder(const ProcessTree *t, uint32_t id, uint32_t stop);
+void tree_set_collapsed(ProcessTree *t, uint32_t id, int collapsed);
+void tree_set_sample(ProcessTree *t, uint32_t id, uint64_t rss_kb, uint32_t cpu_centi);
+uint32_t tree_visible_at(const ProcessTree *t, uint32_t row);
+uint32_t tree_visible_next(const ProcessTree *t, uint32_t id);
+
+char *read_whole_file(const char *path, size_t *len_out);
+const struct pt_record *parse_tree_records(const char *buf, size_t len, struct pt_header *hdr, size_t *count);
+/* Loaders expect a freshly reset tree */
+int tree_load_bin(ProcessTree *t, const char *path);
+int tree_load_text(ProcessTree *t, const char *path);
+int tree_load_proc(ProcessTree *t);
+int tree_load(ProcessTree *t);
+int tree_apply_events(ProcessTree *t, int fd);
+int tree_sync(ProcessTree *t, const ProcessTree *fresh);
+
+#endif
@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "rank.h"
+
+typedef struct RankCtx {
+    const ProcessTree *t;
+    const StatsBuffer *stats;
+    int key;
+} RankCtx;
+
+/* Processes without a sample rank below every sampled one */
+static int before(const RankCtx *c, uint32_t a, uint32_t b) {
+    const ProcessNode *na = &c->t->nodes[a], *nb = &c->t->nodes[b];
+    const ProcStats *sa, *sb;
+    int cmp;
+    switch (c->key) {
+        case RANK_CPU:
+        case RANK_RSS:
+            sa = sampler_lookup(c->stats, c->t, a);
+            sb = sampler_lookup(c->stats, c->t, b);
+            if (!sa || !sb) {
+                if (sa || sb) return sa != NULL;
+                break;
+            }
+            if (c->key == RANK_CPU && sa->cpu_usage != sb->cpu_usage)
+                return sa->cpu_usage > sb->cpu_usage;
+            if (c->key == RANK_RSS && sa->rss_kb != sb->rss_kb)
+                return sa->rss_kb > sb->rss_kb;
+            break;
+        case RANK_NAME:
+            cmp = strcmp(tree_name(c->t, a), tree_name(c->t, b));
+            if (cmp) return cmp < 0;
+            break;
+    }
+    return na->pid < nb->pid;
+}
+
+/* heap[0] is the entry that would be listed last */
+static void sift_down(const RankCtx *c, uint32_t *heap, uint32_t n, uint32_t i) {
+    for (;;) {
+        uint32_t worst = i, l = 2 * i + 1, r = l + 1;
+        if (l < n && before(c, heap[worst], heap[l])) worst = l;
+        if (r < n && before(c, heap[worst], heap[r])) worst = r;
+        if (worst == i) return;
+        uint32_t tmp = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = tmp;
+        i = worst;
+    }
+}
+
+static void sift_up(const RankCtx *c, uint32_t *heap, uint32_t i) {
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (!before(c, heap[parent], heap[i])) return;
+        uint32_t tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+/*
+ * Fills out with up to k node ids, best first, and returns how many.
+ * *total is set to the number of live processes that were ranked.
+ */
+uint32_t rank_top(const ProcessTree *t, const StatsBuffer *stats, int key,
+                  uint32_t k, uint32_t *out, uint32_t *total) {
+    RankCtx c = { t, stats, key };
+    uint32_t n = 0, live = 0;
+    for (uint32_t id = 0; id < t->count; id++) {
+        const ProcessNode *node = &t->nodes[id];
+        if (!(node->flags & NODE_LIVE) || node->pid <= 0) continue;
+        live++;
+        if (n < k) {
+            out[n] = id;
+            sift_up(&c, out, n++);
+        } else if (k > 0 && before(&c, id, out[0])) {
+            out[0] = id;
+            sift_down(&c, out, n, 0);
+        }
+    }
+    /* heapsort in place: the worst goes to the back each round */
+    for (uint32_t end = n; end > 1; end--) {
+        uint32_t tmp = out[0];
+        out[0] = out[end - 1];
+        out[end - 1] = tmp;
+        sift_down(&c, out, end - 1, 0);
+    }
+    *total = live;
+    return n;
+}
@@ -0,0 +1,23 @@
+#ifndef RANK_H
+#define RANK_H
+
+/*
+ * Flat ranking of live processes for the top-N view. rank_top() keeps
+ * the best k in a bounded heap while scanning the tree, so ranking n
+ * processes for one screenful costs O(n log k) rather than a full sort.
+ */
+
+#include <stdint.h>
+
+#include "ps_tree.h"
+#include "sampler.h"
+
+#define RANK_CPU   0    /* highest cpu_usage first */
+#define RANK_RSS   1    /* largest RSS first */
+#define RANK_PID   2
+#define RANK_NAME  3
+
+uint32_t rank_top(const ProcessTree *t, const StatsBuffer *stats, int key,
+                  uint32_t k, uint32_t *out, uint32_t *total);
+
+#endif
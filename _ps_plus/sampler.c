@@ -0,0 +1,649 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "sampler.h"
+#include "stat_ring.h"
+
+#define SAMPLE_INTERVAL_MS 2000
+#define MAX_WORKERS 8
+#define CHUNK 32
+#define MAX_BACKOFF 5           /* off-screen rows wait at most 2^5 sweeps */
+#define KICK_SPACING_MS 250     /* kicks never sweep faster than this */
+#define RING_WAIT_SLICE_MS 100  /* how often a wait for a ring frame checks for stop */
+
+#define KICK_VIEWPORT 0x1       /* the viewport moved: sweep as usual, early */
+#define KICK_FRESH    0x2       /* new processes: read just those */
+
+/* A worker's share of the job list; thieves take the top half */
+typedef struct WorkQueue {
+    pthread_mutex_t lock;
+    uint32_t next;
+    uint32_t end;
+} WorkQueue;
+
+typedef struct Job {
+    uint32_t id;
+    int32_t pid;
+    int visible;
+} Job;
+
+/* When an off-screen node is next due; reset whenever the slot's pid changes */
+typedef struct Schedule {
+    int32_t pid;
+    uint8_t backoff;
+    unsigned long long due;
+    unsigned long long in_view;     /* last sweep the node was on screen */
+} Schedule;
+
+static ProcessTree *tree;
+static pthread_mutex_t *tree_lock;
+
+static StatsBuffer buffers[2];
+static _Atomic(StatsBuffer *) published;
+static atomic_int pins[2];
+static atomic_ullong published_sweep;
+
+static Job *jobs;
+static uint32_t jobs_cap;
+static StatsBuffer *sweep_out;
+static CpuHistory history;
+static StatRing ring;
+static Schedule *schedule;
+static uint32_t schedule_cap;
+
+static atomic_int mode;
+static pthread_mutex_t viewport_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t *viewport;
+static uint32_t viewport_count;
+static uint32_t viewport_cap;
+
+static atomic_ullong bulk_reads;
+static atomic_ullong visible_reads;
+static atomic_ullong background_reads;
+
+static pthread_t sampler_thread;
+static int sampler_running;
+static pthread_t worker_threads[MAX_WORKERS];
+static WorkQueue queues[MAX_WORKERS];
+static int worker_count;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static unsigned long long pool_sweep;
+static int workers_done;
+static int stopping;
+static int kicked;
+static int memory_detail;
+static unsigned interval_ms = SAMPLE_INTERVAL_MS;
+
+static pthread_mutex_t publish_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t publish_cond = PTHREAD_COND_INITIALIZER;
+
+static void add_ms(struct timespec *ts, unsigned ms) {
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static int ts_before(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/*
+ * Pin first, then confirm the buffer is still the published one. Once the
+ * confirmation succeeds the sampler cannot start rewriting it: it only
+ * writes the unpublished half, and waits for that half's pins to drain.
+ */
+const StatsBuffer *sampler_acquire(void) {
+    for (;;) {
+        StatsBuffer *buf = atomic_load(&published);
+        if (!buf) return NULL;
+        atomic_fetch_add(&pins[buf - buffers], 1);
+        if (atomic_load(&published) == buf)
+            return buf;
+        atomic_fetch_sub(&pins[buf - buffers], 1);
+    }
+}
+
+void sampler_release(const StatsBuffer *buf) {
+    if (buf)
+        atomic_fetch_sub(&pins[buf - buffers], 1);
+}
+
+unsigned long long sampler_sweep(void) {
+    return atomic_load_explicit(&published_sweep, memory_order_relaxed);
+}
+
+/* Takes effect from the next sweep */
+void sampler_set_interval(unsigned ms) {
+    pthread_mutex_lock(&pool_lock);
+    interval_ms = ms ? ms : SAMPLE_INTERVAL_MS;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/*
+ * Blocks until a sweep newer than after is published or timeout_ms
+ * passes, and returns the latest published sweep either way.
+ */
+unsigned long long sampler_wait(unsigned long long after, unsigned timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    add_ms(&deadline, timeout_ms);
+    pthread_mutex_lock(&publish_lock);
+    while (sampler_sweep() <= after &&
+           pthread_cond_timedwait(&publish_cond, &publish_lock, &deadline) != ETIMEDOUT)
+        ;
+    pthread_mutex_unlock(&publish_lock);
+    return sampler_sweep();
+}
+
+void sampler_set_mode(int m) {
+    atomic_store(&mode, m);
+}
+
+int sampler_mode(void) {
+    return atomic_load(&mode);
+}
+
+/* Called by the UI after each frame with the node ids it drew */
+void sampler_set_viewport(const uint32_t *ids, uint32_t count) {
+    int changed = 0;
+    pthread_mutex_lock(&viewport_lock);
+    if (count > viewport_cap) {
+        uint32_t *grown = realloc(viewport, count * sizeof(uint32_t));
+        if (!grown) {
+            pthread_mutex_unlock(&viewport_lock);
+            return;
+        }
+        viewport = grown;
+        viewport_cap = count;
+    }
+    if (count != viewport_count || memcmp(viewport, ids, count * sizeof(uint32_t)) != 0) {
+        memcpy(viewport, ids, count * sizeof(uint32_t));
+        viewport_count = count;
+        changed = 1;
+    }
+    pthread_mutex_unlock(&viewport_lock);
+
+    if (changed && sampler_mode() == SAMPLE_VIEWPORT) {
+        pthread_mutex_lock(&pool_lock);
+        kicked |= KICK_VIEWPORT;
+        pthread_cond_signal(&pool_done);
+        pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+/* Call before sampler_start() */
+void sampler_set_memory(int on) {
+    memory_detail = on;
+}
+
+/* Called when processes appeared that should get a first sample now */
+void sampler_kick(void) {
+    pthread_mutex_lock(&pool_lock);
+    kicked |= KICK_FRESH;
+    pthread_cond_signal(&pool_done);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void sampler_counters(SamplerCounters *out) {
+    out->bulk_reads = atomic_load_explicit(&bulk_reads, memory_order_relaxed);
+    out->visible_reads = atomic_load_explicit(&visible_reads, memory_order_relaxed);
+    out->background_reads = atomic_load_explicit(&background_reads, memory_order_relaxed);
+}
+
+const ProcStats *sampler_lookup(const StatsBuffer *buf, const ProcessTree *t, uint32_t id) {
+    if (!buf || id >= buf->count) return NULL;
+    const ProcStats *st = &buf->entries[id];
+    if (!(st->flags & STAT_VALID) || st->pid != t->nodes[id].pid) return NULL;
+    return st;
+}
+
+/*
+ * Feeds a published sweep into the tree's subtree totals. Nodes whose
+ * sample did not change cost one comparison; the rest push their delta
+ * up the parent chain. Runs on the thread that owns the tree.
+ */
+void sampler_roll_up(ProcessTree *t, const StatsBuffer *buf) {
+    for (uint32_t id = 0; id < t->count; id++) {
+        if (!(t->nodes[id].flags & NODE_LIVE)) continue;
+        const ProcStats *st = sampler_lookup(buf, t, id);
+        uint64_t rss = st ? st->rss_kb : 0;
+        uint32_t cpu = st ? (uint32_t)lround(st->cpu_usage * 100.0) : 0;
+        tree_set_sample(t, id, rss, cpu);
+    }
+}
+
+static int reserve_buffer(StatsBuffer *buf, uint32_t count) {
+    if (count > buf->cap) {
+        ProcStats *entries = realloc(buf->entries, count * sizeof(ProcStats));
+        if (!entries) return -1;
+        buf->entries = entries;
+        buf->cap = count;
+    }
+    memset(buf->entries, 0, count * sizeof(ProcStats));
+    buf->count = count;
+    return 0;
+}
+
+static const ProcStats *prev_entry(const StatsBuffer *prev, uint32_t id) {
+    return prev && id < prev->count ? &prev->entries[id] : NULL;
+}
+
+/* Returns the number of /proc files read */
+static int sample_pid(ProcStats *st, int pid) {
+    ProcSample sample;
+    int reads = proc_sample_read(pid, &sample);
+    if (!reads) return 0;
+    st->pid = pid;
+    st->rss_kb = sample.rss_kb;
+    st->nr_threads = sample.nr_threads;
+    st->state = sample.state;
+    st->start_time = sample.start_time;
+    st->runtime_ns = sample.runtime_ns;
+    st->sampled_at = sample.at_ns;
+    st->runtime_source = sample.runtime_source;
+    st->flags = STAT_VALID | STAT_THREADS;
+    if (memory_detail && proc_sample_swap(pid, &st->swap_kb) == 0) {
+        st->vm_kb = sample.vm_kb;
+        st->minflt = sample.minflt;
+        st->majflt = sample.majflt;
+        st->flags |= STAT_MEMORY;
+        reads++;
+    }
+    return reads;
+}
+
+/* CPU usage needs the shared history, so it is filled in after the workers finish */
+static void set_cpu_usage(ProcStats *st) {
+    ProcSample sample = {
+        .pid = st->pid,
+        .runtime_source = st->runtime_source,
+        .start_time = st->start_time,
+        .runtime_ns = st->runtime_ns,
+        .at_ns = st->sampled_at,
+    };
+    st->cpu_usage = cpu_history_update(&history, &sample);
+}
+
+/*
+ * Fills out from kernel stats records. CPU usage is left to the caller so
+ * that a frame found torn afterwards never reaches the history.
+ */
+static int fill_from_records(StatsBuffer *out, const struct pt_record *records, size_t count,
+                             uint64_t sampled_at) {
+    unsigned long long ns_per_tick = 1000000000ULL / sysconf(_SC_CLK_TCK);
+    if (reserve_buffer(out, tree->count) < 0)
+        return -1;
+    for (size_t i = 0; i < count; i++) {
+        const struct pt_record *rec = &records[i];
+        uint32_t id = tree_find_pid(tree, rec->pid);
+        if (id == NODE_NONE || rec->pid <= 0) continue;
+        ProcStats *st = &out->entries[id];
+        st->pid = rec->pid;
+        st->start_time = rec->start_time_ns / ns_per_tick;
+        st->runtime_ns = rec->runtime_ns;
+        st->sampled_at = sampled_at;
+        st->runtime_source = RUNTIME_KERNEL;
+        st->rss_kb = rec->rss_kb;
+        st->nr_threads = rec->nr_threads;
+        st->state = rec->state;
+        st->flags = STAT_VALID | STAT_THREADS;
+    }
+    return 0;
+}
+
+static void set_all_cpu_usage(StatsBuffer *out) {
+    for (uint32_t id = 0; id < out->count; id++)
+        if (out->entries[id].flags & STAT_VALID)
+            set_cpu_usage(&out->entries[id]);
+}
+
+static int is_stopping(void) {
+    pthread_mutex_lock(&pool_lock);
+    int stop = stopping;
+    pthread_mutex_unlock(&pool_lock);
+    return stop;
+}
+
+/*
+ * The next frame of the shared kernel ring, read in place. A sweep that
+ * comes before the module's next frame waits up to wait_ms for it, so
+ * a sampler faster than the module never falls back to /proc.
+ */
+static int sample_from_ring(StatsBuffer *out, unsigned wait_ms) {
+    uint64_t deadline = monotonic_ns() + wait_ms * 1000000ULL;
+    const struct pt_frame *frame;
+    uint64_t now;
+    while (!(frame = stat_ring_latest(&ring)) && (now = monotonic_ns()) < deadline && !is_stopping()) {
+        uint64_t left_ms = (deadline - now + 999999) / 1000000;
+        stat_ring_wait(&ring, left_ms < RING_WAIT_SLICE_MS ? left_ms : RING_WAIT_SLICE_MS);
+    }
+    if (!frame) return -1;
+    pthread_mutex_lock(tree_lock);
+    int err = fill_from_records(out, (const struct pt_record *)(frame + 1), frame->count,
+                                frame->timestamp_ns);
+    if (err == 0 && !stat_ring_intact(&ring))
+        err = -1;
+    if (err == 0) {
+        set_all_cpu_usage(out);
+        atomic_fetch_add_explicit(&bulk_reads, 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(tree_lock);
+    return err;
+}
+
+/* One read of /proc/process_tree.stats instead of two /proc/<pid> files per node */
+static int sample_from_stats(StatsBuffer *out) {
+    size_t len, count;
+    struct pt_header hdr;
+    char *buf = read_whole_file("/proc/" PT_PROC_STATS, &len);
+    if (!buf) return -1;
+    atomic_fetch_add_explicit(&bulk_reads, 1, memory_order_relaxed);
+    const struct pt_record *records = parse_tree_records(buf, len, &hdr, &count);
+    if (!records || !(hdr.flags & PT_FLAG_STATS)) {
+        free(buf);
+        return -1;
+    }
+
+    pthread_mutex_lock(tree_lock);
+    int err = fill_from_records(out, records, count, monotonic_ns());
+    if (err == 0)
+        set_all_cpu_usage(out);
+    pthread_mutex_unlock(tree_lock);
+    free(buf);
+    return err;
+}
+
+static int take_work(WorkQueue *q, uint32_t *lo, uint32_t *hi) {
+    int ok = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->next < q->end) {
+        *lo = q->next;
+        *hi = q->end - q->next > CHUNK ? q->next + CHUNK : q->end;
+        q->next = *hi;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok;
+}
+
+static int steal_work(int self, uint32_t *lo, uint32_t *hi) {
+    for (int i = 1; i < worker_count; i++) {
+        WorkQueue *victim = &queues[(self + i) % worker_count];
+        uint32_t from = 0, to = 0;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->next < victim->end) {
+            from = victim->next + (victim->end - victim->next) / 2;
+            to = victim->end;
+            victim->end = from;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (from < to) {
+            WorkQueue *q = &queues[self];
+            pthread_mutex_lock(&q->lock);
+            q->next = from;
+            q->end = to;
+            pthread_mutex_unlock(&q->lock);
+            return take_work(q, lo, hi);
+        }
+    }
+    return 0;
+}
+
+static void *worker_func(void *arg) {
+    int self = (int)(intptr_t)arg;
+    unsigned long long seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool_lock);
+        while (seen == pool_sweep && !stopping)
+            pthread_cond_wait(&pool_start, &pool_lock);
+        if (stopping) {
+            pthread_mutex_unlock(&pool_lock);
+            break;
+        }
+        seen = pool_sweep;
+        pthread_mutex_unlock(&pool_lock);
+
+        uint32_t lo, hi;
+        unsigned long long reads[2] = {0, 0};
+        while (take_work(&queues[self], &lo, &hi) || steal_work(self, &lo, &hi)) {
+            for (uint32_t i = lo; i < hi; i++) {
+                ProcStats *st = &sweep_out->entries[jobs[i].id];
+                reads[jobs[i].visible] += sample_pid(st, jobs[i].pid);
+            }
+        }
+        atomic_fetch_add_explicit(&background_reads, reads[0], memory_order_relaxed);
+        atomic_fetch_add_explicit(&visible_reads, reads[1], memory_order_relaxed);
+
+        pthread_mutex_lock(&pool_lock);
+        if (++workers_done == worker_count)
+            pthread_cond_signal(&pool_done);
+        pthread_mutex_unlock(&pool_lock);
+    }
+    return NULL;
+}
+
+static int reserve_schedule(uint32_t count) {
+    if (count > schedule_cap) {
+        Schedule *grown = realloc(schedule, count * sizeof(Schedule));
+        if (!grown) return -1;
+        memset(grown + schedule_cap, 0, (count - schedule_cap) * sizeof(Schedule));
+        schedule = grown;
+        schedule_cap = count;
+    }
+    return 0;
+}
+
+/*
+ * Decides whether node id is read this sweep. Visible rows always are;
+ * off-screen rows double their wait each time they are read, and start
+ * over from one sweep once they have been on screen again.
+ */
+static int due_this_sweep(uint32_t id, int32_t pid, unsigned long long sweep, int viewport_mode) {
+    Schedule *sc = &schedule[id];
+    if (sc->pid != pid) {
+        sc->pid = pid;
+        sc->backoff = 0;
+        sc->due = 0;
+    }
+    if (sc->in_view == sweep) {
+        sc->backoff = 0;
+        sc->due = sweep + 1;
+        return 1;
+    }
+    if (viewport_mode && sweep < sc->due)
+        return 0;
+    if (sc->backoff < MAX_BACKOFF)
+        sc->backoff++;
+    sc->due = sweep + (1ULL << sc->backoff);
+    return 1;
+}
+
+/* With fresh_only, reads just the nodes prev has no sample for */
+static int sample_parallel(StatsBuffer *out, const StatsBuffer *prev, unsigned long long sweep,
+                           int fresh_only) {
+    uint32_t njobs = 0;
+    int viewport_mode = sampler_mode() == SAMPLE_VIEWPORT;
+    pthread_mutex_lock(tree_lock);
+    if (reserve_buffer(out, tree->count) < 0 || reserve_schedule(tree->count) < 0) {
+        pthread_mutex_unlock(tree_lock);
+        return -1;
+    }
+    if (tree->count > jobs_cap) {
+        Job *grown = realloc(jobs, tree->count * sizeof(Job));
+        if (!grown) {
+            pthread_mutex_unlock(tree_lock);
+            return -1;
+        }
+        jobs = grown;
+        jobs_cap = tree->count;
+    }
+    pthread_mutex_lock(&viewport_lock);
+    for (uint32_t i = 0; i < viewport_count; i++)
+        if (viewport[i] < tree->count)
+            schedule[viewport[i]].in_view = sweep;
+    pthread_mutex_unlock(&viewport_lock);
+    for (uint32_t id = 0; id < tree->count; id++) {
+        const ProcessNode *node = &tree->nodes[id];
+        if (!(node->flags & NODE_LIVE) || node->pid <= 0) continue;
+        const ProcStats *last = prev_entry(prev, id);
+        int have_last = last && last->pid == node->pid && (last->flags & STAT_VALID);
+        if (have_last && (fresh_only || !due_this_sweep(id, node->pid, sweep, viewport_mode))) {
+            out->entries[id] = *last;
+            continue;
+        }
+        if (!have_last)
+            due_this_sweep(id, node->pid, sweep, 0);
+        jobs[njobs].id = id;
+        jobs[njobs].pid = node->pid;
+        jobs[njobs].visible = schedule[id].in_view == sweep;
+        njobs++;
+    }
+    pthread_mutex_unlock(tree_lock);
+
+    for (int w = 0; w < worker_count; w++) {
+        queues[w].next = (uint64_t)njobs * w / worker_count;
+        queues[w].end = (uint64_t)njobs * (w + 1) / worker_count;
+    }
+    sweep_out = out;
+
+    pthread_mutex_lock(&pool_lock);
+    workers_done = 0;
+    pool_sweep++;
+    pthread_cond_broadcast(&pool_start);
+    while (workers_done < worker_count && !stopping)
+        pthread_cond_wait(&pool_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+
+    for (uint32_t i = 0; i < njobs; i++) {
+        ProcStats *st = &out->entries[jobs[i].id];
+        if (st->flags & STAT_VALID)
+            set_cpu_usage(st);
+    }
+    return 0;
+}
+
+/*
+ * Sleeps until the sample interval after the last full sweep has passed,
+ * or once kicked until KICK_SPACING_MS after the last sweep of any kind.
+ * Returns nonzero once sampler_stop() was called, sets *ms to the
+ * interval in force, and *fresh_only when only new processes asked for
+ * this sweep.
+ */
+static int wait_interval(const struct timespec *last_full, const struct timespec *last,
+                         unsigned *ms, int *fresh_only) {
+    struct timespec deadline = *last_full, earliest = *last, now;
+    pthread_mutex_lock(&pool_lock);
+    add_ms(&deadline, interval_ms);
+    add_ms(&earliest, KICK_SPACING_MS);
+    while (!stopping &&
+           pthread_cond_timedwait(&pool_done, &pool_lock,
+                                  kicked && ts_before(&earliest, &deadline) ? &earliest : &deadline) != ETIMEDOUT)
+        ;
+    clock_gettime(CLOCK_REALTIME, &now);
+    *fresh_only = kicked == KICK_FRESH && ts_before(&now, &deadline);
+    kicked = 0;
+    int stop = stopping;
+    *ms = interval_ms;
+    pthread_mutex_unlock(&pool_lock);
+    return stop;
+}
+
+/*
+ * With the ring device open every sweep comes from it. When no frame
+ * arrives in time the last sweep stays published rather than being
+ * replaced by a /proc read; the stats dump and the per-process files are
+ * only for when the module offers no ring. A fresh-only sweep doesn't
+ * start a new history epoch or move the next full sweep, so a stream of
+ * forks can't age out the samples CPU usage is measured against.
+ */
+static void *sampler_func(void *arg) {
+    struct timespec last_full, last;
+    unsigned ms;
+    int fresh_only;
+    clock_gettime(CLOCK_REALTIME, &last_full);
+    last = last_full;
+    while (!wait_interval(&last_full, &last, &ms, &fresh_only)) {
+        clock_gettime(CLOCK_REALTIME, &last);
+        if (!fresh_only) {
+            last_full = last;
+            cpu_history_begin(&history);
+        }
+
+        StatsBuffer *prev = atomic_load(&published);
+        StatsBuffer *back = prev == &buffers[0] ? &buffers[1] : &buffers[0];
+        while (atomic_load(&pins[back - buffers]) > 0)
+            sched_yield();
+        unsigned long long sweep = prev ? prev->sweep + 1 : 1;
+        int err;
+        if (memory_detail)
+            err = sample_parallel(back, prev, sweep, fresh_only);
+        else if (ring.fd >= 0)
+            err = sample_from_ring(back, ms);
+        else if ((err = sample_from_stats(back)) < 0)
+            err = sample_parallel(back, prev, sweep, fresh_only);
+        if (err < 0)
+            continue;
+        back->sweep = sweep;
+        atomic_store(&published, back);
+        pthread_mutex_lock(&publish_lock);
+        atomic_store_explicit(&published_sweep, back->sweep, memory_order_relaxed);
+        pthread_cond_broadcast(&publish_cond);
+        pthread_mutex_unlock(&publish_lock);
+    }
+    return NULL;
+}
+
+int sampler_start(ProcessTree *t, pthread_mutex_t *lock, int workers) {
+    tree = t;
+    tree_lock = lock;
+    worker_count = workers < 1 ? 1 : workers > MAX_WORKERS ? MAX_WORKERS : workers;
+    ring.fd = -1;
+    if (!memory_detail)
+        stat_ring_open(&ring);
+    for (int w = 0; w < worker_count; w++) {
+        pthread_mutex_init(&queues[w].lock, NULL);
+        if (pthread_create(&worker_threads[w], NULL, worker_func, (void *)(intptr_t)w)) {
+            worker_count = w;
+            sampler_stop();
+            return -1;
+        }
+    }
+    if (pthread_create(&sampler_thread, NULL, sampler_func, NULL)) {
+        sampler_stop();
+        return -1;
+    }
+    sampler_running = 1;
+    return 0;
+}
+
+void sampler_stop(void) {
+    pthread_mutex_lock(&pool_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&pool_start);
+    pthread_cond_broadcast(&pool_done);
+    pthread_mutex_unlock(&pool_lock);
+    if (sampler_running)
+        pthread_join(sampler_thread, NULL);
+    for (int w = 0; w < worker_count; w++)
+        pthread_join(worker_threads[w], NULL);
+    free(buffers[0].entries);
+    free(buffers[1].entries);
+    free(jobs);
+    free(schedule);
+    free(viewport);
+    cpu_history_free(&history);
+    stat_ring_close(&ring);
+}
@@ -0,0 +1,92 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+/*
+ * Background sampler for per-process CPU and memory. Each sweep fills the
+ * back half of a double buffer, indexed by tree node id, and publishes it
+ * with an atomic pointer swap.
+ *
+ * Readers pin the published buffer with sampler_acquire() for the length
+ * of a frame and drop it with sampler_release(). The sampler waits for a
+ * buffer's pins to drain before reusing it, so a reader always sees one
+ * complete sweep, however long it holds on.
+ *
+ * In SAMPLE_VIEWPORT mode only the rows handed to sampler_set_viewport()
+ * are read every sweep. Off-screen processes back off to every 2nd, 4th,
+ * ... 32nd sweep and keep their last sample in between, and a viewport
+ * change triggers an early sweep so rows scrolled into view catch up.
+ *
+ * When the module's stats ring is available, a sweep instead takes its
+ * newest frame, waiting up to one interval for a frame it hasn't used;
+ * if none comes, the previous sweep stays published. Without the ring a
+ * sweep reads the kernel stats dump if there is one. Either covers
+ * everything at once and is used in both modes.
+ *
+ * sampler_set_memory() before sampler_start() adds the VM size, fault
+ * counts and swap, which the bulk sources don't carry, so every sweep
+ * then reads /proc/<pid>. sampler_kick() asks for an early sweep that
+ * reads only processes without a sample yet and carries the rest, so a
+ * new process is seen well before the next interval.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "ps_tree.h"
+#include "proc_sample.h"
+
+#define STAT_VALID    0x1
+#define STAT_THREADS  0x2   /* nr_threads and state are filled in */
+#define STAT_MEMORY   0x4   /* vm_kb, minflt, majflt and swap_kb are filled in */
+
+#define SAMPLE_ALL       0
+#define SAMPLE_VIEWPORT  1
+
+typedef struct ProcStats {
+    int32_t pid;
+    uint32_t nr_threads;
+    uint64_t rss_kb;
+    uint64_t start_time;        /* with pid, the key into the CPU history */
+    uint64_t runtime_ns;
+    uint64_t sampled_at;        /* CLOCK_MONOTONIC ns when runtime_ns was read */
+    double cpu_usage;           /* percent of all online CPUs */
+    uint64_t vm_kb;
+    uint64_t minflt;
+    uint64_t majflt;
+    uint64_t swap_kb;
+    char state;
+    uint8_t flags;
+    uint8_t runtime_source;
+} ProcStats;
+
+typedef struct StatsBuffer {
+    ProcStats *entries;
+    uint32_t count;
+    uint32_t cap;
+    unsigned long long sweep;
+} StatsBuffer;
+
+/* Running totals of files read, by tier */
+typedef struct SamplerCounters {
+    unsigned long long bulk_reads;          /* kernel stats dumps and ring frames */
+    unsigned long long visible_reads;       /* /proc/<pid> files for on-screen rows */
+    unsigned long long background_reads;    /* /proc/<pid> files for everything else */
+} SamplerCounters;
+
+int sampler_start(ProcessTree *t, pthread_mutex_t *tree_lock, int workers);
+void sampler_stop(void);
+const StatsBuffer *sampler_acquire(void);
+void sampler_release(const StatsBuffer *buf);
+unsigned long long sampler_sweep(void);
+unsigned long long sampler_wait(unsigned long long after, unsigned timeout_ms);
+void sampler_set_interval(unsigned ms);
+void sampler_set_mode(int mode);
+int sampler_mode(void);
+void sampler_set_viewport(const uint32_t *ids, uint32_t count);
+void sampler_set_memory(int on);
+void sampler_kick(void);
+void sampler_counters(SamplerCounters *out);
+const ProcStats *sampler_lookup(const StatsBuffer *buf, const ProcessTree *t, uint32_t id);
+void sampler_roll_up(ProcessTree *t, const StatsBuffer *buf);
+
+#endif
@@ -0,0 +1,199 @@
+#include <ncurses.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "screen.h"
+
+static int io_fd = -1;
+
+/*
+ * curses writes straight to the terminal fd, so the byte count comes from
+ * the process's wchar in /proc/self/io. Nothing else in the process
+ * writes while a frame is flushed, so the delta around refresh() is what
+ * the frame cost.
+ */
+static unsigned long long bytes_written() {
+    char buf[512];
+    if (io_fd < 0) return 0;
+    ssize_t n = pread(io_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+    char *wchar = strstr(buf, "wchar:");
+    return wchar ? strtoull(wchar + 6, NULL, 10) : 0;
+}
+
+static void invalidate(ScreenRow *rows, int from, int to) {
+    for (int r = from; r < to; r++)
+        rows[r].len = -1;
+}
+
+static void clear_rows(ScreenRow *rows, int count) {
+    for (int r = 0; r < count; r++) {
+        rows[r].len = 0;
+        rows[r].x = 0;
+        rows[r].attr = 0;
+        rows[r].has_cells = 0;
+    }
+}
+
+static int alloc_rows(Screen *s) {
+    free(s->shown);
+    free(s->next);
+    free(s->text);
+    free(s->cells);
+    s->rows = LINES;
+    s->cols = COLS;
+    s->shown = calloc(s->rows, sizeof(ScreenRow));
+    s->next = calloc(s->rows, sizeof(ScreenRow));
+    s->text = malloc((size_t)s->rows * 2 * (s->cols + 1));
+    s->cells = malloc((size_t)s->rows * 2 * s->cols * sizeof(int));
+    if (!s->shown || !s->next || !s->text || !s->cells) return -1;
+    for (int r = 0; r < s->rows; r++) {
+        s->shown[r].text = s->text + (size_t)r * (s->cols + 1);
+        s->next[r].text = s->text + (size_t)(s->rows + r) * (s->cols + 1);
+        s->shown[r].cells = s->cells + (size_t)r * s->cols;
+        s->next[r].cells = s->cells + (size_t)(s->rows + r) * s->cols;
+    }
+    invalidate(s->shown, 0, s->rows);
+    clear_rows(s->next, s->rows);
+    return 0;
+}
+
+/* Stands in for initscr() */
+int screen_open(Screen *s) {
+    memset(s, 0, sizeof(*s));
+    if (!initscr()) return -1;
+    idlok(stdscr, TRUE);
+    io_fd = open("/proc/self/io", O_RDONLY);
+    return alloc_rows(s);
+}
+
+void screen_close(Screen *s) {
+    endwin();
+    if (io_fd >= 0) {
+        close(io_fd);
+        io_fd = -1;
+    }
+    free(s->shown);
+    free(s->next);
+    free(s->text);
+    free(s->cells);
+    memset(s, 0, sizeof(*s));
+}
+
+/* Call on KEY_RESIZE; the next flush repaints everything */
+void screen_resize(Screen *s) {
+    alloc_rows(s);
+    clearok(stdscr, TRUE);
+}
+
+void screen_put(Screen *s, int row, int x, int attr, const char *fmt, ...) {
+    if (row < 0 || row >= s->rows || x < 0 || x >= s->cols) return;
+    ScreenRow *r = &s->next[row];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(r->text, s->cols - x + 1, fmt, ap);
+    va_end(ap);
+    if (len < 0) len = 0;
+    r->len = len > s->cols - x ? s->cols - x : len;
+    r->x = x;
+    r->attr = attr;
+    r->has_cells = 0;
+}
+
+void screen_put_cells(Screen *s, int row, int x, const char *text, const int *attrs, int len) {
+    if (row < 0 || row >= s->rows || x < 0 || x >= s->cols || len < 0) return;
+    ScreenRow *r = &s->next[row];
+    if (len > s->cols - x) len = s->cols - x;
+    memcpy(r->text, text, len);
+    memcpy(r->cells, attrs, len * sizeof(int));
+    r->len = len;
+    r->x = x;
+    r->attr = 0;
+    r->has_cells = 1;
+}
+
+static int same_row(const ScreenRow *a, const ScreenRow *b) {
+    return a->len == b->len && a->x == b->x && a->attr == b->attr && a->has_cells == b->has_cells &&
+           memcmp(a->text, b->text, a->len) == 0 &&
+           (!a->has_cells || memcmp(a->cells, b->cells, a->len * sizeof(int)) == 0);
+}
+
+/* Draws a cell row as runs of equal attributes */
+static void draw_cells(int row, const ScreenRow *r) {
+    for (int i = 0, run; i < r->len; i += run) {
+        for (run = 1; i + run < r->len && r->cells[i + run] == r->cells[i]; run++)
+            ;
+        attron(r->cells[i]);
+        mvaddnstr(row, r->x + i, r->text + i, run);
+        attroff(r->cells[i]);
+    }
+}
+
+/*
+ * Scrolls rows top..bottom by n (positive moves content up) on the
+ * terminal and in the shown frame, leaving the exposed rows blank.
+ */
+void screen_scroll(Screen *s, int top, int bottom, int n) {
+    if (bottom >= s->rows) bottom = s->rows - 1;
+    int height = bottom - top + 1;
+    if (n == 0 || top < 0 || height <= 0) return;
+    if (n >= height || -n >= height) {
+        invalidate(s->shown, top, bottom + 1);
+        return;
+    }
+
+    setscrreg(top, bottom);
+    scrollok(stdscr, TRUE);
+    wscrl(stdscr, n);
+    scrollok(stdscr, FALSE);
+    setscrreg(0, s->rows - 1);
+
+    /* rotate the row structs so their text buffers follow the content */
+    ScreenRow moved[height];
+    for (int i = 0; i < height; i++)
+        moved[i] = s->shown[top + (i + n + height) % height];
+    for (int i = 0; i < height; i++) {
+        s->shown[top + i] = moved[i];
+        if (i + n < 0 || i + n >= height) {
+            s->shown[top + i].len = 0;
+            s->shown[top + i].x = 0;
+            s->shown[top + i].attr = 0;
+            s->shown[top + i].has_cells = 0;
+        }
+    }
+}
+
+void screen_flush(Screen *s) {
+    s->rows_drawn = 0;
+    for (int r = 0; r < s->rows; r++) {
+        ScreenRow *want = &s->next[r], *have = &s->shown[r];
+        if (same_row(want, have))
+            continue;
+        move(r, 0);
+        clrtoeol();
+        if (want->has_cells) {
+            draw_cells(r, want);
+        } else if (want->len > 0) {
+            attron(want->attr);
+            mvaddnstr(r, want->x, want->text, want->len);
+            attroff(want->attr);
+        }
+        s->rows_drawn++;
+    }
+
+    unsigned long long before = bytes_written();
+    refresh();
+    unsigned long long after = bytes_written();
+    s->bytes_frame = after - before;
+    s->bytes_total += s->bytes_frame;
+
+    ScreenRow *tmp = s->shown;
+    s->shown = s->next;
+    s->next = tmp;
+    clear_rows(s->next, s->rows);
+}
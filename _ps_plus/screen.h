@@ -0,0 +1,45 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+/*
+ * Row-level damage tracking on top of curses. Each frame is described
+ * with screen_put(), one segment per row, and screen_flush() touches only
+ * the rows whose text, column or attributes differ from what the terminal
+ * already shows. screen_scroll() shifts a band of rows with the terminal's
+ * scroll region, so rows that merely moved are not redrawn.
+ * screen_put_cells() gives a row one attribute per character instead.
+ *
+ * bytes_frame is what the last flush sent to the terminal, bytes_total the
+ * sum over all flushes since screen_open().
+ */
+
+typedef struct ScreenRow {
+    char *text;
+    int *cells;     /* per-character attributes when has_cells is set */
+    int len;        /* -1 when the terminal contents are unknown */
+    int x;
+    int attr;
+    int has_cells;
+} ScreenRow;
+
+typedef struct Screen {
+    ScreenRow *shown;   /* what the terminal holds */
+    ScreenRow *next;    /* frame being composed */
+    char *text;         /* backing store for both row sets */
+    int *cells;
+    int rows;
+    int cols;
+    int rows_drawn;     /* rows repainted by the last flush */
+    unsigned long long bytes_frame;
+    unsigned long long bytes_total;
+} Screen;
+
+int screen_open(Screen *s);
+void screen_close(Screen *s);
+void screen_resize(Screen *s);
+void screen_put(Screen *s, int row, int x, int attr, const char *fmt, ...);
+void screen_put_cells(Screen *s, int row, int x, const char *text, const int *attrs, int len);
+void screen_scroll(Screen *s, int top, int bottom, int n);
+void screen_flush(Screen *s);
+
+#endif
@@ -0,0 +1,74 @@
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "stat_ring.h"
+
+/* Returns 0 with the ring mapped, or -1 if the module doesn't provide one */
+int stat_ring_open(StatRing *r) {
+    memset(r, 0, sizeof(*r));
+    r->fd = open("/dev/" PT_RING_DEV, O_RDONLY | O_CLOEXEC);
+    if (r->fd < 0) return -1;
+
+    /* the control page says how much more there is to map */
+    long page = sysconf(_SC_PAGESIZE);
+    const struct pt_ring_control *ctl = mmap(NULL, page, PROT_READ, MAP_SHARED, r->fd, 0);
+    if (ctl == MAP_FAILED) goto fail;
+    int ok = ctl->magic == PT_RING_MAGIC && ctl->version == PT_VERSION &&
+             ctl->record_size == sizeof(struct pt_record);
+    size_t size = ctl->data_offset + ctl->data_size;
+    munmap((void *)ctl, page);
+    if (!ok) goto fail;
+
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, r->fd, 0);
+    if (map == MAP_FAILED) goto fail;
+    r->ctl = map;
+    r->data = (const char *)map + r->ctl->data_offset;
+    r->map_size = size;
+    return 0;
+
+fail:
+    close(r->fd);
+    r->fd = -1;
+    return -1;
+}
+
+void stat_ring_close(StatRing *r) {
+    if (r->ctl)
+        munmap((void *)r->ctl, r->map_size);
+    if (r->fd >= 0)
+        close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+/* The newest frame if it is newer than the last one handed out, else NULL */
+const struct pt_frame *stat_ring_latest(StatRing *r) {
+    if (!r->ctl) return NULL;
+    unsigned long long seq = __atomic_load_n(&r->ctl->frames, __ATOMIC_ACQUIRE);
+    unsigned long long pos = __atomic_load_n(&r->ctl->last_frame, __ATOMIC_ACQUIRE);
+    if (seq == 0 || seq == r->seq) return NULL;
+
+    const struct pt_frame *f = (const struct pt_frame *)(r->data + (pos & (r->ctl->data_size - 1)));
+    r->pos = pos;
+    if (f->magic != PT_FRAME_MAGIC || f->size > r->ctl->data_size / 2 ||
+        sizeof(*f) + (size_t)f->count * sizeof(struct pt_record) > f->size || !stat_ring_intact(r))
+        return NULL;
+    r->seq = f->seq;
+    return f;
+}
+
+/* Call after using a frame; 0 means it was overwritten and has to be dropped */
+int stat_ring_intact(const StatRing *r) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&r->ctl->tail, __ATOMIC_RELAXED) <= r->pos;
+}
+
+/* Returns 1 once a frame was published since the last time it did, 0 on timeout, -1 on error */
+int stat_ring_wait(const StatRing *r, unsigned timeout_ms) {
+    if (r->fd < 0) return -1;
+    struct pollfd pfd = { .fd = r->fd, .events = POLLIN };
+    return poll(&pfd, 1, timeout_ms);
+}
@@ -0,0 +1,32 @@
+#ifndef STAT_RING_H
+#define STAT_RING_H
+
+/*
+ * Reader side of /dev/process_tree_ring (layout in process_tree.h).
+ * Frames are used in place in the shared mapping: stat_ring_latest()
+ * hands out the newest frame, and stat_ring_intact() afterwards says
+ * whether the module overwrote it while it was being read. The frame's
+ * pt_records start right after its header. stat_ring_wait() sleeps
+ * until the module publishes another frame.
+ */
+
+#include <stddef.h>
+
+#include "process_tree.h"
+
+typedef struct StatRing {
+    int fd;
+    const struct pt_ring_control *ctl;
+    const char *data;
+    size_t map_size;
+    unsigned long long pos;         /* position of the frame last handed out */
+    unsigned long long seq;
+} StatRing;
+
+int stat_ring_open(StatRing *r);
+void stat_ring_close(StatRing *r);
+const struct pt_frame *stat_ring_latest(StatRing *r);
+int stat_ring_intact(const StatRing *r);
+int stat_ring_wait(const StatRing *r, unsigned timeout_ms);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef TASK_WALK_H
+#define TASK_WALK_H
+
+/*
+ * Pre-order walk of a task subtree over real_parent, children and
+ * sibling, shared by kernel_mod.c, memplot/writer.c and paraplot's
+ * mapper.c. Those links are guarded by tasklist_lock, which modules
+ * can't take, so the walk runs under rcu_read_lock() and re-checks each
+ * step instead:
+ *
+ * - A task found on a children list is used only while its real_parent
+ *   is still that list's owner. Reparenting rewrites real_parent before
+ *   it moves the list, so a mismatch ends the sibling run. A list head
+ *   misread as a task still lies inside a task_struct, and fails the
+ *   same check.
+ * - An exited task is unlinked with list_del_init(), so its sibling link
+ *   points back at itself, which also ends the run.
+ * - The climb back up takes at most *depth steps and stops at root or
+ *   init_task. If a task was reparented out of root's subtree, its new
+ *   parent fails task_walk_inside() and the walk ends there, rather
+ *   than wandering into the rest of the tree.
+ *
+ * Tasks that move mid-walk may be missed, like anything else read from
+ * /proc without stopping the system.
+ */
+
+#include <linux/sched.h>
+#include <linux/sched/task.h>
+#include <linux/rculist.h>
+
+/* Whether task is root or below it, at most levels steps down; caller holds rcu_read_lock() */
+static inline bool task_walk_inside(struct task_struct *root, struct task_struct *task, int levels)
+{
+    for (; levels >= 0; levels--) {
+        if (task == root)
+            return true;
+        if (task == &init_task)
+            return false;
+        task = rcu_dereference(task->real_parent);
+    }
+    return false;
+}
+
+/*
+ * Pre-order successor of task without leaving root's subtree, or NULL.
+ * *depth is task's level below root and is kept in step. Caller holds
+ * rcu_read_lock().
+ */
+static inline struct task_struct *task_walk_next(struct task_struct *root, struct task_struct *task,
+                                                 int *depth)
+{
+    struct task_struct *parent, *next;
+
+    next = list_first_or_null_rcu(&task->children, struct task_struct, sibling);
+    if (next && rcu_access_pointer(next->real_parent) == task) {
+        (*depth)++;
+        return next;
+    }
+
+    while (task != root && task != &init_task && *depth > 0) {
+        parent = rcu_dereference(task->real_parent);
+        if (!task_walk_inside(root, parent, *depth - 1))
+            return NULL;
+        next = NULL;
+        if (pid_alive(task))
+            next = list_next_or_null_rcu(&parent->children, &task->sibling,
+                                         struct task_struct, sibling);
+        if (next && next != task && rcu_access_pointer(next->real_parent) == parent)
+            return next;
+        task = parent;
+        (*depth)--;
+    }
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "addr_map.h"
+
+/* vm_flags bits, numbered as the kernel does, so both sources read alike */
+#define VMF_READ    0x1
+#define VMF_WRITE   0x2
+#define VMF_EXEC    0x4
+#define VMF_SHARED  0x8
+
+#define PAGES_CHUNK (64 * 1024)
+
+int addr_perm(uint64_t vm_flags) {
+    if (vm_flags & VMF_EXEC) return ADDR_PERM_EXEC;
+    if (vm_flags & VMF_WRITE) return ADDR_PERM_WRITE;
+    if (vm_flags & VMF_READ) return ADDR_PERM_READ;
+    return ADDR_PERM_NONE;
+}
+
+static int reserve_vmas(AddrSpace *as, size_t count) {
+    if (count <= as->cap) return 0;
+    size_t cap = as->cap ? as->cap : 256;
+    while (cap < count)
+        cap *= 2;
+    struct mt_vma *grown = realloc(as->vmas, cap * sizeof(*grown));
+    if (!grown) return -1;
+    as->vmas = grown;
+    as->cap = cap;
+    return 0;
+}
+
+/* One snapshot from /proc/mem_tree/pages; fd is open read-write */
+static int load_pages(AddrSpace *as, int pid, int fd) {
+    char pid_text[16];
+    int len = snprintf(pid_text, sizeof(pid_text), "%d", pid);
+    if (fd < 0 || write(fd, pid_text, len) != len)
+        return -1;
+
+    size_t size = 0, cap = PAGES_CHUNK;
+    char *buf = malloc(cap);
+    ssize_t n;
+    while (buf && (n = pread(fd, buf + size, cap - size, size)) > 0) {
+        size += n;
+        if (size == cap) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) {
+                free(buf);
+                buf = NULL;
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+    }
+
+    /* an older module sends a shorter header; the layout then reads as zero */
+    struct mt_pages_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    if (buf && size >= offsetof(struct mt_pages_header, mmap_base))
+        memcpy(&hdr, buf, size < sizeof(hdr) ? size : sizeof(hdr));
+    if (!buf || hdr.magic != MT_PAGES_MAGIC || hdr.record_size != sizeof(struct mt_vma) ||
+        hdr.header_size > size || hdr.pid != pid) {
+        free(buf);
+        return -1;
+    }
+    if (hdr.header_size < sizeof(hdr))
+        memset((char *)&hdr + hdr.header_size, 0, sizeof(hdr) - hdr.header_size);
+
+    size_t count = (size - hdr.header_size) / hdr.record_size;
+    if (count > hdr.count)
+        count = hdr.count;
+    if (reserve_vmas(as, count) < 0) {
+        free(buf);
+        return -1;
+    }
+    memcpy(as->vmas, buf + hdr.header_size, count * sizeof(struct mt_vma));
+    as->count = count;
+    as->flags = ADDR_RESIDENT | (hdr.header_size >= sizeof(hdr) ? ADDR_LAYOUT : 0);
+    as->mmap_base = hdr.mmap_base;
+    as->start_brk = hdr.start_brk;
+    as->brk = hdr.brk;
+    as->start_stack = hdr.start_stack;
+    free(buf);
+    return 0;
+}
+
+static uint64_t parse_hex(const char *p, const char **end) {
+    uint64_t value = 0;
+    for (;; p++) {
+        int digit = *p >= '0' && *p <= '9' ? *p - '0' :
+                    *p >= 'a' && *p <= 'f' ? *p - 'a' + 10 : -1;
+        if (digit < 0) break;
+        value = value << 4 | digit;
+    }
+    *end = p;
+    return value;
+}
+
+/* "start-end perms offset dev inode [path]", one VMA per line */
+static int load_maps(AddrSpace *as, int pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    char *line = NULL, *exe = NULL;
+    size_t line_cap = 0;
+    uint64_t exe_end = 0;
+    as->count = 0;
+    while (getline(&line, &line_cap, file) > 0) {
+        const char *p;
+        uint64_t start = parse_hex(line, &p);
+        if (*p != '-') continue;
+        uint64_t end = parse_hex(p + 1, &p);
+        if (*p != ' ' || strlen(p) < 5) continue;
+        const char *perms = p + 1;
+        /* offset, dev and inode are hex, ':' and spaces, so the name starts at '[' or '/' */
+        const char *name = strpbrk(perms + 4, "[/");
+        if (name && strncmp(name, "[vsyscall]", 10) == 0)
+            continue;
+        if (reserve_vmas(as, as->count + 1) < 0)
+            break;
+
+        struct mt_vma *vma = &as->vmas[as->count++];
+        memset(vma, 0, sizeof(*vma));
+        vma->start = start;
+        vma->end = end;
+        vma->flags = (perms[0] == 'r' ? VMF_READ : 0) | (perms[1] == 'w' ? VMF_WRITE : 0) |
+                     (perms[2] == 'x' ? VMF_EXEC : 0) | (perms[3] == 's' ? VMF_SHARED : 0);
+        /* the executable comes first; its bss may follow as an anonymous mapping */
+        size_t name_len = name ? strcspn(name, "\n") : 0;
+        if (as->count == 1 && name && *name == '/')
+            exe = strndup(name, name_len);
+        if (exe && name && strncmp(name, exe, name_len) == 0 && !exe[name_len])
+            exe_end = end;
+        else if (exe && !name && start == exe_end)
+            exe_end = end;
+
+        if (name && strncmp(name, "[heap]", 6) == 0) {
+            as->start_brk = start;
+            as->brk = end;
+        } else if (name && strncmp(name, "[stack]", 7) == 0) {
+            as->start_stack = start;
+        }
+    }
+    free(line);
+    free(exe);
+    fclose(file);
+
+    /* no [heap] yet: brk starts right after the executable, as the kernel places it */
+    if (!as->brk)
+        as->start_brk = as->brk = exe_end;
+    /* the first mmap, normally the dynamic loader, lands just below mmap_base */
+    for (size_t i = 0; i < as->count && as->vmas[i].end <= as->start_stack; i++)
+        as->mmap_base = as->vmas[i].end;
+    as->flags = 0;
+    return 0;
+}
+
+int addr_space_load(AddrSpace *as, int pid, int pages_fd) {
+    as->pid = pid;
+    as->count = 0;
+    as->flags = 0;
+    as->mmap_base = as->start_brk = as->brk = as->start_stack = 0;
+    if (load_pages(as, pid, pages_fd) == 0)
+        return 0;
+    return load_maps(as, pid);
+}
+
+void addr_space_free(AddrSpace *as) {
+    free(as->vmas);
+    memset(as, 0, sizeof(*as));
+}
+
+static void add_gap(AddrStats *st, uint64_t start, uint64_t end) {
+    if (end <= start) return;
+    st->mmap_free += end - start;
+    if (end - start > st->largest_gap) {
+        st->largest_gap = end - start;
+        st->largest_gap_start = start;
+    }
+}
+
+#define AREA_BELOW   0
+#define AREA_INSIDE  1
+#define AREA_ABOVE   2
+
+/* Returns the bin width in bytes */
+uint64_t addr_map_bin(const AddrSpace *as, uint64_t lo, uint64_t hi, AddrBin *bins, int nbins, AddrStats *st) {
+    memset(bins, 0, nbins * sizeof(*bins));
+    memset(st, 0, sizeof(*st));
+    st->nr_vmas = as->count;
+    uint64_t width = hi > lo ? (hi - lo - 1) / nbins + 1 : 1;
+    uint64_t area_lo = as->brk, area_hi = as->mmap_base, prev_end = 0;
+    int area = AREA_BELOW;
+
+    for (size_t i = 0; i < as->count; i++) {
+        const struct mt_vma *vma = &as->vmas[i];
+        uint64_t len = vma->end - vma->start;
+        st->mapped += len;
+
+        /* the gap below the lowest mmap is unallocated, not fragmentation */
+        if (vma->start >= area_lo && vma->start < area_hi) {
+            if (area == AREA_BELOW)
+                st->mmap_depth = area_hi - vma->start;
+            else
+                add_gap(st, prev_end, vma->start);
+            area = AREA_INSIDE;
+        } else if (vma->start >= area_hi && area == AREA_INSIDE) {
+            add_gap(st, prev_end, area_hi);
+            area = AREA_ABOVE;
+        }
+        prev_end = vma->end;
+
+        if (vma->end <= lo || vma->start >= hi || !len)
+            continue;
+        uint64_t start = vma->start > lo ? vma->start : lo;
+        uint64_t end = vma->end < hi ? vma->end : hi;
+        int perm = addr_perm(vma->flags);
+        double resident_share = (as->flags & ADDR_RESIDENT) ? (double)vma->present_kb * 1024 / len : 0;
+        for (uint64_t b = (start - lo) / width; b < (uint64_t)nbins && lo + b * width < end; b++) {
+            uint64_t bin_lo = lo + b * width, bin_hi = bin_lo + width;
+            uint64_t overlap = (end < bin_hi ? end : bin_hi) - (start > bin_lo ? start : bin_lo);
+            bins[b].mapped += overlap;
+            bins[b].resident += (uint64_t)(overlap * resident_share);
+            bins[b].perm_bytes[perm] += overlap;
+            bins[b].vmas++;
+        }
+    }
+    if (area == AREA_INSIDE)
+        add_gap(st, prev_end, area_hi);
+
+    for (int b = 0; b < nbins; b++)
+        for (int p = 1; p < ADDR_NR_PERMS; p++)
+            if (bins[b].perm_bytes[p] > bins[b].perm_bytes[bins[b].perm])
+                bins[b].perm = p;
+    return width;
+}
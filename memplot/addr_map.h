@@ -0,0 +1,71 @@
+#ifndef ADDR_MAP_H
+#define ADDR_MAP_H
+
+/*
+ * Address-space map for memplot. A process's VMAs come from
+ * /proc/mem_tree/pages when the module is loaded, with residency per VMA
+ * and the mm's layout, or else from /proc/<pid>/maps, where the layout
+ * is guessed from [heap], [stack] and the mappings below the stack and
+ * residency is unknown.
+ *
+ * addr_map_bin() folds the sorted VMAs into fixed-width bins over
+ * [lo, hi) and works out the fragmentation figures in the same pass.
+ * Each VMA is visited once and each bin at most once more per VMA that
+ * touches it, so the cost is VMAs plus bins, whatever the process size.
+ *
+ * Fragmentation is measured in the mmap area: from the end of the heap
+ * up to mmap_base, where top-down mmap() places new mappings. The free
+ * gaps between its mappings are what later mmaps can reuse; a largest
+ * gap well below the total free means the area is fragmented.
+ * mmap_depth is how far below mmap_base the lowest mapping reaches.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mem_tree.h"
+
+#define ADDR_PERM_NONE   0      /* guard pages and PROT_NONE reservations */
+#define ADDR_PERM_READ   1
+#define ADDR_PERM_WRITE  2
+#define ADDR_PERM_EXEC   3
+#define ADDR_NR_PERMS    4
+
+#define ADDR_RESIDENT  0x1      /* present_kb is filled in */
+#define ADDR_LAYOUT    0x2      /* mmap_base and brk came from the kernel */
+
+typedef struct AddrSpace {
+    int pid;
+    int flags;
+    struct mt_vma *vmas;        /* sorted by address */
+    size_t count;
+    size_t cap;
+    uint64_t mmap_base;
+    uint64_t start_brk;
+    uint64_t brk;
+    uint64_t start_stack;
+} AddrSpace;
+
+typedef struct AddrBin {
+    uint64_t mapped;            /* bytes */
+    uint64_t resident;          /* bytes, spread evenly over each VMA */
+    uint64_t perm_bytes[ADDR_NR_PERMS];
+    uint32_t vmas;
+    uint8_t perm;               /* the class covering the most bytes */
+} AddrBin;
+
+typedef struct AddrStats {
+    size_t nr_vmas;
+    uint64_t mapped;
+    uint64_t mmap_depth;
+    uint64_t mmap_free;         /* sum of gaps inside the mmap area */
+    uint64_t largest_gap;
+    uint64_t largest_gap_start;
+} AddrStats;
+
+int addr_perm(uint64_t vm_flags);
+int addr_space_load(AddrSpace *as, int pid, int pages_fd);
+void addr_space_free(AddrSpace *as);
+uint64_t addr_map_bin(const AddrSpace *as, uint64_t lo, uint64_t hi, AddrBin *bins, int nbins, AddrStats *stats);
+
+#endif
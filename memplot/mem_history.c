@@ -0,0 +1,65 @@
+#include <string.h>
+
+#include "mem_history.h"
+
+#define GROWTH_KB_S      64.0   /* sustained RSS growth worth flagging */
+#define GROWTH_MIN_KB    1024   /* ... once it adds up to this much over the ring */
+#define MAJFLT_RATE      20.0   /* major faults per second */
+#define SWAP_IN_KB_S     256.0
+
+/* A new start_time means the pid was reused; the old samples are dropped */
+void mem_history_push(MemHistory *h, uint64_t start_time, const MemSample *s) {
+    if (h->count && h->start_time != start_time)
+        memset(h, 0, sizeof(*h));
+    h->start_time = start_time;
+    h->ring[h->next] = *s;
+    h->next = (h->next + 1) % MEM_HISTORY_LEN;
+    if (h->count < MEM_HISTORY_LEN)
+        h->count++;
+}
+
+/* i = 0 is the oldest sample still held */
+static const MemSample *sample_at(const MemHistory *h, int i) {
+    return &h->ring[(h->next + MEM_HISTORY_LEN - h->count + i) % MEM_HISTORY_LEN];
+}
+
+static double rss_slope(const MemHistory *h) {
+    const MemSample *first = sample_at(h, 0);
+    double sum_t = 0, sum_r = 0, sum_tt = 0, sum_tr = 0;
+    for (int i = 0; i < h->count; i++) {
+        const MemSample *s = sample_at(h, i);
+        double t = (s->at_ns - first->at_ns) / 1e9, r = s->rss_kb;
+        sum_t += t;
+        sum_r += r;
+        sum_tt += t * t;
+        sum_tr += t * r;
+    }
+    double n = h->count, denom = n * sum_tt - sum_t * sum_t;
+    return denom > 0 ? (n * sum_tr - sum_t * sum_r) / denom : 0.0;
+}
+
+void mem_history_trend(const MemHistory *h, MemTrend *out) {
+    memset(out, 0, sizeof(*out));
+    if (h->count < 2) return;
+    const MemSample *prev = sample_at(h, h->count - 2), *last = sample_at(h, h->count - 1);
+    double span = (last->at_ns - prev->at_ns) / 1e9;
+    if (span <= 0) return;
+
+    /* counters only go backwards if the pid changed hands between samples */
+    if (last->minflt >= prev->minflt)
+        out->minflt_rate = (last->minflt - prev->minflt) / span;
+    if (last->majflt >= prev->majflt)
+        out->majflt_rate = (last->majflt - prev->majflt) / span;
+    if (last->swap_kb > prev->swap_kb)
+        out->swap_out_kb_s = (last->swap_kb - prev->swap_kb) / span;
+    else
+        out->swap_in_kb_s = (prev->swap_kb - last->swap_kb) / span;
+
+    if (h->count >= MEM_TREND_MIN) {
+        out->rss_slope_kb_s = rss_slope(h);
+        if (out->rss_slope_kb_s >= GROWTH_KB_S && last->rss_kb >= sample_at(h, 0)->rss_kb + GROWTH_MIN_KB)
+            out->flags |= MEM_GROWING;
+    }
+    if (out->majflt_rate >= MAJFLT_RATE || out->swap_in_kb_s >= SWAP_IN_KB_S)
+        out->flags |= MEM_FAULTING;
+}
@@ -0,0 +1,51 @@
+#ifndef MEM_HISTORY_H
+#define MEM_HISTORY_H
+
+/*
+ * Per-process memory history for memplot. Every process keeps its last
+ * MEM_HISTORY_LEN samples in a fixed ring. Fault and swap rates come from
+ * the two newest samples; the RSS slope is a least-squares fit over the
+ * whole ring, so one allocation spike doesn't read as a leak.
+ *
+ * A process is flagged MEM_GROWING when its RSS keeps climbing, by at
+ * least a megabyte, across MEM_TREND_MIN or more samples, and
+ * MEM_FAULTING when it takes major faults or swaps back in at a rate
+ * that means its working set doesn't fit in memory.
+ */
+
+#include <stdint.h>
+
+#define MEM_HISTORY_LEN  16
+#define MEM_TREND_MIN    4
+
+#define MEM_GROWING   0x1
+#define MEM_FAULTING  0x2
+
+typedef struct MemSample {
+    uint64_t at_ns;         /* CLOCK_MONOTONIC */
+    uint64_t rss_kb;
+    uint64_t swap_kb;
+    uint64_t minflt;
+    uint64_t majflt;
+} MemSample;
+
+typedef struct MemHistory {
+    MemSample ring[MEM_HISTORY_LEN];
+    uint64_t start_time;    /* of the process the samples belong to */
+    uint8_t next;
+    uint8_t count;
+} MemHistory;
+
+typedef struct MemTrend {
+    double minflt_rate;     /* per second */
+    double majflt_rate;
+    double swap_out_kb_s;
+    double swap_in_kb_s;
+    double rss_slope_kb_s;
+    int flags;
+} MemTrend;
+
+void mem_history_push(MemHistory *h, uint64_t start_time, const MemSample *s);
+void mem_history_trend(const MemHistory *h, MemTrend *out);
+
+#endif
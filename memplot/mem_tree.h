@@ -0,0 +1,141 @@
+#ifndef MEM_TREE_H
+#define MEM_TREE_H
+
+/*
+ * Binary interface of /proc/mem_tree, shared by writer.c and userspace.
+ *
+ * /proc/mem_tree/summary works like /proc/mem_tree/map: write a pid to
+ * the open file, then each read from offset 0 returns one mt_summary for
+ * that process, built in a single pass over its VMAs. Like every file
+ * here, it only accepts and reads a pid whose /proc/<pid>/maps the
+ * reader could open; others fail with EACCES.
+ *
+ * The first five categories split the address space: every VMA counts
+ * as exactly one of stack, heap, shared, file or anon, checked in that
+ * order. MT_EXEC overlaps them and totals the executable mappings. The
+ * rss_* fields come from the mm's own counters, not a page walk.
+ *
+ * /proc/mem_tree/pages is selected the same way and returns an
+ * mt_pages_header followed by one mt_vma per VMA, counted by walking
+ * the page tables. The whole read is one snapshot: it is taken with a
+ * single mmap_read_lock when a read starts at offset 0. shared_kb is
+ * memory mapped by more than one process, and pss_kb splits every page
+ * evenly between its mappers, as in smaps. Hugetlb VMAs report no pages.
+ * The header also carries the mm's layout, read under the same lock, so
+ * readers can tell the heap and the mmap area apart.
+ *
+ * /proc/mem_tree/subtree takes the pid of a subtree's root the same way
+ * and returns an mt_subtree_header followed by one mt_share per process
+ * in the subtree, pre-order. Each process's page tables are walked in
+ * turn, counting every page's mappers: uss_kb is what only that process
+ * maps, pss_kb its proportional share. Pages mapped more than once are
+ * also counted per subtree; when all of a page's mappers are inside the
+ * subtree it adds to inside_kb, otherwise to outside_kb. So uss_kb plus
+ * inside_kb in the header is what the whole subtree costs, and a worker's
+ * uss_kb plus pgtables_kb is what one more of the same kind would add.
+ * Mapcounts are read without stopping the processes, so the split is a
+ * close estimate on a busy subtree, not an exact one. The file is root's
+ * only, and even then a process the reader can't ptrace-read is listed
+ * with MT_SHARE_DENIED and zero counts rather than walked.
+ */
+
+#include <linux/types.h>
+
+#define MT_PROC_DIR       "mem_tree"
+#define MT_SUMMARY_FILE   "summary"
+#define MT_PAGES_FILE     "pages"
+#define MT_SUBTREE_FILE   "subtree"
+#define MT_SUMMARY_MAGIC  0x4d545355   /* "MTSU" */
+#define MT_PAGES_MAGIC    0x4d545047   /* "MTPG" */
+#define MT_SUBTREE_MAGIC  0x4d545354   /* "MTST" */
+#define MT_VERSION        3
+
+#define MT_STACK   0
+#define MT_HEAP    1
+#define MT_SHARED  2
+#define MT_FILE    3
+#define MT_ANON    4
+#define MT_EXEC    5
+#define MT_NR_CATEGORIES 6
+
+struct mt_summary {
+    __u32 magic;
+    __u16 version;
+    __u16 size;             /* sizeof(struct mt_summary) */
+    __s32 pid;
+    __u32 nr_vmas;
+    __u64 total_vm_kb;
+    __u64 vm_kb[MT_NR_CATEGORIES];
+    __u32 vmas[MT_NR_CATEGORIES];
+    __u64 rss_anon_kb;
+    __u64 rss_file_kb;
+    __u64 rss_shmem_kb;
+    __u64 swap_kb;
+    __u64 hiwater_rss_kb;
+    __u64 pgtables_kb;
+};
+
+struct mt_pages_header {
+    __u32 magic;
+    __u16 version;
+    __u16 header_size;
+    __u32 record_size;
+    __s32 pid;
+    __u32 count;            /* mt_vma records that follow */
+    __u32 reserved;
+    __u64 mmap_base;        /* where top-down mmap allocation starts */
+    __u64 start_brk;        /* heap, as set by brk() */
+    __u64 brk;
+    __u64 start_stack;
+};
+
+struct mt_vma {
+    __u64 start;
+    __u64 end;
+    __u64 flags;            /* vm_flags */
+    __u64 present_kb;       /* as smaps Rss: the zero page and PFN maps are left out */
+    __u64 swap_kb;
+    __u64 dirty_kb;
+    __u64 thp_kb;           /* present through PMD-mapped huge pages */
+    __u64 shared_kb;
+    __u64 pss_kb;
+};
+
+#define MT_SUBTREE_PARTIAL  0x1   /* shared pages went untracked; inside_kb is low */
+#define MT_SUBTREE_DENIED   0x2   /* some processes were skipped, see MT_SHARE_DENIED */
+
+#define MT_SHARE_DENIED     0x1   /* not readable by the caller; its counts are zero */
+
+struct mt_subtree_header {
+    __u32 magic;
+    __u16 version;
+    __u16 header_size;
+    __u32 record_size;
+    __s32 pid;              /* the root */
+    __u32 count;            /* mt_share records that follow */
+    __u32 flags;
+    __u64 rss_kb;           /* summed over the processes, shared pages every time */
+    __u64 pss_kb;
+    __u64 uss_kb;
+    __u64 inside_kb;        /* shared, only within the subtree */
+    __u64 outside_kb;       /* shared with processes outside it too */
+    __u64 swap_kb;
+    __u64 pgtables_kb;
+};
+
+struct mt_share {
+    __s32 pid;
+    __s32 ppid;
+    __u16 depth;            /* below the root */
+    __u16 flags;            /* MT_SHARE_* */
+    __u32 reserved2;
+    char  comm[16];
+    __u64 rss_kb;
+    __u64 pss_kb;
+    __u64 uss_kb;
+    __u64 shared_kb;
+    __u64 swap_kb;
+    __u64 pgtables_kb;
+};
+
+#endif
@@ -3,134 +3,811 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
 #include <unistd.h>
 
-#define MAX_VISIBLE_NODES 1024
-
-typedef struct ProcessNode {
-    char name[256];
-    int pid;
-    int depth;
-    int collapsed;
-    char mem_usage[64];
-    double cpu_usage;
-    struct ProcessNode *child;
-    struct ProcessNode *next;
-} ProcessNode;
-
-ProcessNode *head = NULL;
-ProcessNode *visible_nodes[MAX_VISIBLE_NODES];
-int visible_count = 0;
+#include "../_ps_plus/ps_tree.h"
+#include "../_ps_plus/screen.h"
+#include "../_ps_plus/proc_sample.h"
+#include "../_ps_plus/sampler.h"
+#include "../_ps_plus/event_sources.h"
+#include "mem_tree.h"
+#include "mem_history.h"
+#include "addr_map.h"
+#include "share_report.h"
+
+#define SAMPLE_SECONDS  2
+#define REDRAW_MS       1000
+#define SWEEP_POLL_MS   100  /* how soon a published sweep reaches the columns */
+
+#define PAIR_GROWING   1
+#define PAIR_FAULTING  2
+#define PAIR_EXEC      3
+#define PAIR_WRITE     4
+#define PAIR_NOACCESS  5
+
+#define MAP_LABEL  13       /* "%012llx " before each map row */
+#define MAP_ZOOM   8
+
+/*
+ * Per-process numbers, one array per field, indexed by tree node id, so
+ * sorting and totals run over plain integers. pid records which process
+ * a row was filled for: a node id handed to a new process starts clean.
+ */
+typedef struct MemColumns {
+    int32_t *pid;
+    uint64_t *rss_kb;
+    uint64_t *vm_kb;
+    uint64_t *cpu_ns;
+    uint32_t *cpu_centi;    /* hundredths of a percent of the machine */
+    uint64_t *at_ns;        /* when the row's sample was taken */
+    MemHistory *history;
+    MemTrend *trend;
+    uint32_t cap;
+} MemColumns;
+
+ProcessTree tree;
+MemColumns columns;
+pthread_mutex_t tree_lock = PTHREAD_MUTEX_INITIALIZER;
+uint32_t *sorted_ids = NULL;
+uint32_t sorted_cap = 0;
+uint32_t sorted_count = 0;
+unsigned long long rows_changed = 1;    /* bumped whenever samples or the tree change */
+unsigned long long sorted_at = 0;       /* the rows_changed the RSS order was built for */
+int sort_by_rss = 0;
 int selected_index = 0;
 int scroll_offset = 0;
+int drawn_scroll = 0;
+int summary_fd = -1;
+int pages_fd = -1;
+int subtree_fd = -1;
+Screen screen;
 
-void flatten_tree_recursive(ProcessNode *node) {
-    if (!node) return;
-    if (visible_count < MAX_VISIBLE_NODES)
-        visible_nodes[visible_count++] = node;
-    if (!node->collapsed)
-        flatten_tree_recursive(node->child);
-    flatten_tree_recursive(node->next);
-}
-
-void flatten_tree() {
-    visible_count = 0;
-    flatten_tree_recursive(head);
-}
-
-ProcessNode* create_process_node(const char *name, int pid, int depth) {
-    ProcessNode *node = malloc(sizeof(ProcessNode));
-    if (!node) return NULL;
-    strncpy(node->name, name, 255);
-    node->pid = pid;
-    node->depth = depth;
-    node->collapsed = 0;
-    strcpy(node->mem_usage, "N/A");
-    node->cpu_usage = 0.0;
-    node->child = NULL;
-    node->next = NULL;
-    return node;
-}
-
-void update_process_info(ProcessNode *node) {
-    if (!node || node->pid <= 0) return;
-    char path[256], buffer[256];
-    FILE *fp;
-    unsigned long utime = 0, stime = 0;
-
-    snprintf(path, sizeof(path), "/proc/%d/status", node->pid);
-    if ((fp = fopen(path, "r"))) {
-        while (fgets(buffer, sizeof(buffer), fp)) {
-            if (strncmp(buffer, "VmRSS:", 6) == 0) {
-                sscanf(buffer, "VmRSS:%s", node->mem_usage);
-                break;
-            }
+/* Fork/exit events keep the tree current between samples; /proc is then only a resync */
+EventSources sources;   /* applied and read by the sampler thread; exits_seen and last_exit under tree_lock */
+
+/* Set on quit; the pipe wakes the update thread out of its wait */
+atomic_int stopping;
+int wake_pipe[2] = { -1, -1 };
+
+/* Address map view: shown while map_pid is set */
+AddrSpace space;
+AddrBin *bins = NULL;
+int bins_cap = 0;
+int map_pid = 0;
+uint64_t map_lo = 0, map_hi = 0;    /* both 0 for the whole address space */
+int map_cursor = 0;
+uint64_t map_loaded_ns = 0;
+
+/* Shared-memory report: shown while share_pid is set */
+ShareReport report;
+int share_pid = 0;
+int share_scroll = 0;
+uint64_t share_loaded_ns = 0;
+
+void *grow_column(void *column, size_t size, uint32_t old_cap, uint32_t cap) {
+    char *grown = realloc(column, (size_t)cap * size);
+    if (grown)
+        memset(grown + (size_t)old_cap * size, 0, (size_t)(cap - old_cap) * size);
+    return grown;
+}
+
+/* Makes room for node ids below count; caller must hold tree_lock */
+int reserve_columns(uint32_t count) {
+    if (count <= columns.cap) return 0;
+    uint32_t cap = columns.cap ? columns.cap * 2 : 1024;
+    while (cap < count)
+        cap *= 2;
+#define GROW(field) \
+    do { \
+        void *grown = grow_column(columns.field, sizeof(*columns.field), columns.cap, cap); \
+        if (!grown) return -1; \
+        columns.field = grown; \
+    } while (0)
+    GROW(pid);
+    GROW(rss_kb);
+    GROW(vm_kb);
+    GROW(cpu_ns);
+    GROW(cpu_centi);
+    GROW(at_ns);
+    GROW(history);
+    GROW(trend);
+#undef GROW
+    columns.cap = cap;
+    return 0;
+}
+
+void reset_row(uint32_t id, int pid) {
+    columns.pid[id] = pid;
+    columns.rss_kb[id] = 0;
+    columns.vm_kb[id] = 0;
+    columns.cpu_ns[id] = 0;
+    columns.cpu_centi[id] = 0;
+    columns.at_ns[id] = 0;
+    memset(&columns.history[id], 0, sizeof(columns.history[id]));
+    memset(&columns.trend[id], 0, sizeof(columns.trend[id]));
+}
+
+/*
+ * Reloads the snapshot into a scratch tree without tree_lock, then
+ * reconciles under it, so node ids, and with them the columns, survive.
+ * Only the update thread applies events, so none slip in between.
+ * Returns 1 if the tree changed.
+ */
+int resync_process_tree() {
+    event_sources_load(&sources);
+    pthread_mutex_lock(&tree_lock);
+    int changed = event_sources_sync(&sources, &tree);
+    if (changed)
+        rows_changed++;
+    pthread_mutex_unlock(&tree_lock);
+    return changed;
+}
+
+/*
+ * Returns 1 if the tree changed, 0 if not, -1 if events were lost and
+ * the caller has to resync. Caller must hold tree_lock.
+ */
+int apply_tree_events() {
+    int changed = event_sources_apply(&sources, &tree);
+    if (changed < 0)
+        return -1;
+    if (changed)
+        rows_changed++;
+    while (event_sources_read_exits(&sources) > 0)
+        ;
+    return changed;
+}
+
+/* Waits until an event source is readable or deadline passes; returns 1 for events, 0 on timeout or quit */
+int wait_for_events(uint64_t deadline_ns) {
+    struct pollfd fds[4] = { { .fd = wake_pipe[0], .events = POLLIN } };
+    int nfds = 1 + event_sources_pollfds(&sources, fds + 1);
+    uint64_t now = monotonic_ns();
+    if (now >= deadline_ns || atomic_load(&stopping))
+        return 0;
+    int timeout_ms = (deadline_ns - now + 999999) / 1000000;
+    return poll(fds, nfds, timeout_ms) > 0 && !fds[0].revents;
+}
+
+/* Caller must hold tree_lock */
+void apply_sample(uint32_t id, const ProcStats *st) {
+    if (columns.pid[id] != st->pid)
+        reset_row(id, st->pid);
+    if (columns.at_ns[id] == st->sampled_at)
+        return;     /* carried over from an earlier sweep */
+
+    columns.at_ns[id] = st->sampled_at;
+    columns.rss_kb[id] = st->rss_kb;
+    columns.vm_kb[id] = st->vm_kb;
+    columns.cpu_ns[id] = st->runtime_ns;
+    columns.cpu_centi[id] = (uint32_t)(st->cpu_usage * 100.0 + 0.5);
+    tree_set_sample(&tree, id, st->rss_kb, columns.cpu_centi[id]);
+
+    MemSample mem = {
+        .at_ns = st->sampled_at,
+        .rss_kb = st->rss_kb,
+        .swap_kb = st->swap_kb,
+        .minflt = st->minflt,
+        .majflt = st->majflt,
+    };
+    mem_history_push(&columns.history[id], st->start_time, &mem);
+    mem_history_trend(&columns.history[id], &columns.trend[id]);
+}
+
+/* Copies the sampler's latest sweep into the columns; caller must hold tree_lock */
+void apply_sweep() {
+    const StatsBuffer *stats = sampler_acquire();
+    if (reserve_columns(tree.count) == 0) {
+        for (uint32_t id = 0; id < tree.count; id++) {
+            const ProcStats *st = sampler_lookup(stats, &tree, id);
+            if (st && (tree.nodes[id].flags & NODE_LIVE) && (st->flags & STAT_MEMORY))
+                apply_sample(id, st);
         }
-        fclose(fp);
     }
+    sampler_release(stats);
+    rows_changed++;
+}
 
-    snprintf(path, sizeof(path), "/proc/%d/stat", node->pid);
-    if ((fp = fopen(path, "r"))) {
-        if (fgets(buffer, sizeof(buffer), fp)) {
-            sscanf(buffer, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*lu %*lu %*lu %*lu %lu %lu", &utime, &stime);
-            node->cpu_usage = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+/*
+ * The sampler's pool reads /proc every SAMPLE_SECONDS; this thread
+ * follows fork and exit events and copies each published sweep into the
+ * columns. cpu is percent of all online CPUs since the process's last
+ * sample. New processes kick the sampler, which reads just those, so
+ * even one that lives well under SAMPLE_SECONDS shows up with its memory.
+ */
+void *update_thread_func(void *arg) {
+    unsigned long long applied = 0;
+    while (!atomic_load(&stopping)) {
+        int events = wait_for_events(monotonic_ns() + SWEEP_POLL_MS * 1000000ULL);
+        pthread_mutex_lock(&tree_lock);
+        int changed = events ? apply_tree_events() : 0;
+        unsigned long long sweep = sampler_sweep();
+        if (sweep != applied) {
+            apply_sweep();
+            applied = sweep;
         }
-        fclose(fp);
+        pthread_mutex_unlock(&tree_lock);
+
+        if (!atomic_load(&stopping) && (changed < 0 || event_sources_resync_due(&sources)))
+            changed = resync_process_tree();
+        if (changed > 0)
+            sampler_kick();
     }
+    return NULL;
+}
+
+int compare_rss_desc(const void *a, const void *b) {
+    uint64_t x = columns.rss_kb[*(const uint32_t *)a], y = columns.rss_kb[*(const uint32_t *)b];
+    return (x < y) - (x > y);
+}
+
+/*
+ * Every sampled process, largest RSS first. The order is kept until the
+ * samples or the tree change, so redraws and keypresses in between
+ * reuse it. Caller must hold tree_lock.
+ */
+uint32_t sort_rows() {
+    if (sorted_at == rows_changed)
+        return sorted_count;
+    sorted_count = 0;
+    if (reserve_columns(tree.count) < 0)
+        return 0;
+    if (tree.count > sorted_cap) {
+        uint32_t *grown = realloc(sorted_ids, tree.count * sizeof(uint32_t));
+        if (!grown) return 0;
+        sorted_ids = grown;
+        sorted_cap = tree.count;
+    }
+    for (uint32_t id = 0; id < tree.count; id++)
+        if ((tree.nodes[id].flags & NODE_LIVE) && columns.pid[id] == tree.nodes[id].pid)
+            sorted_ids[sorted_count++] = id;
+    qsort(sorted_ids, sorted_count, sizeof(uint32_t), compare_rss_desc);
+    sorted_at = rows_changed;
+    return sorted_count;
+}
+
+/* Row count of the current view; caller must hold tree_lock */
+int view_rows() {
+    return sort_by_rss ? (int)sort_rows() : (int)tree.visible_rows;
 }
 
+uint32_t view_at(int row) {
+    return sort_by_rss ? sorted_ids[row] : tree_visible_at(&tree, row);
+}
+
+uint32_t view_next(uint32_t id, int row) {
+    return sort_by_rss ? sorted_ids[row] : tree_visible_next(&tree, id);
+}
+
+/* One mt_summary for pid from /proc/mem_tree/summary; 0 without the module or access, errno says which */
+int read_summary(int pid, struct mt_summary *out) {
+    char buf[16];
+    errno = 0;
+    int len = snprintf(buf, sizeof(buf), "%d", pid);
+    if (summary_fd < 0 || write(summary_fd, buf, len) != len)
+        return 0;
+    return pread(summary_fd, out, sizeof(*out), 0) == (ssize_t)sizeof(*out) &&
+           out->magic == MT_SUMMARY_MAGIC && out->pid == pid;
+}
+
+void render_details(int row, uint32_t id) {
+    struct mt_summary s;
+    int pid = tree.nodes[id].pid;
+    if (!read_summary(pid, &s)) {
+        const char *why = summary_fd < 0 ? "load mem_tree for a breakdown" :
+                          errno == EACCES ? "no access to its breakdown" : "no breakdown";
+        screen_put(&screen, row, 0, 0, "PID %d: VM %llu kB, cpu %.3f s (%s)",
+                   pid, (unsigned long long)columns.vm_kb[id], columns.cpu_ns[id] / 1e9, why);
+        return;
+    }
+    screen_put(&screen, row, 0, 0,
+               "PID %d: %u VMAs  stack %llu heap %llu shared %llu file %llu anon %llu exec %llu kB"
+               "  rss anon %llu file %llu shmem %llu  swap %llu  peak %llu  pgtables %llu kB",
+               pid, s.nr_vmas, s.vm_kb[MT_STACK], s.vm_kb[MT_HEAP], s.vm_kb[MT_SHARED], s.vm_kb[MT_FILE],
+               s.vm_kb[MT_ANON], s.vm_kb[MT_EXEC], s.rss_anon_kb, s.rss_file_kb, s.rss_shmem_kb,
+               s.swap_kb, s.hiwater_rss_kb, s.pgtables_kb);
+}
+
+/* Faulting outranks growing: thrashing is the more urgent of the two */
+int trend_attr(const MemTrend *trend) {
+    int pair = trend->flags & MEM_FAULTING ? PAIR_FAULTING : trend->flags & MEM_GROWING ? PAIR_GROWING : 0;
+    if (!pair) return 0;
+    return has_colors() ? COLOR_PAIR(pair) | A_BOLD : A_BOLD;
+}
+
+void render_row(int row, uint32_t id, int selected) {
+    const ProcessNode *node = &tree.nodes[id];
+    const MemTrend *tr = &columns.trend[id];
+    int x = sort_by_rss ? 0 : node->depth * 4;
+    int attr = (selected ? A_REVERSE : 0) | trend_attr(tr);
+    const char *marker = node->child == NODE_NONE ? "   " : node->collapsed ? "[+]" : "[-]";
+    if (node->collapsed && node->child != NODE_NONE)
+        screen_put(&screen, row, x, attr,
+                   "%s %s [PID: %d] RSS: %llu kB VM: %llu kB CPU: %.2f%%  subtree RSS: %llu kB CPU: %.2f%%",
+                   marker, tree_name(&tree, id), node->pid, (unsigned long long)columns.rss_kb[id],
+                   (unsigned long long)columns.vm_kb[id], columns.cpu_centi[id] / 100.0,
+                   (unsigned long long)node->subtree_rss_kb, node->subtree_cpu_centi / 100.0);
+    else
+        screen_put(&screen, row, x, attr,
+                   "%s %s [PID: %d] RSS: %llu kB %+.0f kB/s VM: %llu kB CPU: %.2f%%"
+                   "  faults/s min %.0f maj %.0f  swap in %.0f out %.0f kB/s",
+                   marker, tree_name(&tree, id), node->pid, (unsigned long long)columns.rss_kb[id],
+                   tr->rss_slope_kb_s, (unsigned long long)columns.vm_kb[id], columns.cpu_centi[id] / 100.0,
+                   tr->minflt_rate, tr->majflt_rate, tr->swap_in_kb_s, tr->swap_out_kb_s);
+}
+
+/* Caller must hold tree_lock */
 void render_process_tree() {
-    clear();
-    for (int i = scroll_offset; i < visible_count && i < scroll_offset + (LINES - 2); i++) {
-        ProcessNode *node = visible_nodes[i];
-        int x = node->depth * 4;
-        if (i == selected_index) attron(A_REVERSE);
-        mvprintw(i - scroll_offset, x, "%s %s [PID: %d] Mem: %s CPU: %.2f%%",
-                 node->collapsed ? "[+]" : "[-]", node->name, node->pid, node->mem_usage, node->cpu_usage);
-        if (i == selected_index) attroff(A_REVERSE);
-    }
-    refresh();
-}
-
-void* update_thread_func(void *arg) {
-    while (1) {
-        sleep(2);
-        for (int i = 0; i < visible_count; i++) {
-            update_process_info(visible_nodes[i]);
+    /* events and resyncs grow the tree before the sampler gets to the new rows */
+    if (reserve_columns(tree.count) < 0)
+        return;
+    int max_rows = LINES - 2;
+    int rows = view_rows();
+    if (selected_index >= rows)
+        selected_index = rows > 0 ? rows - 1 : 0;
+    if (selected_index < scroll_offset)
+        scroll_offset = selected_index;
+    else if (selected_index >= scroll_offset + max_rows)
+        scroll_offset = selected_index - max_rows + 1;
+    if (scroll_offset != drawn_scroll)
+        screen_scroll(&screen, 0, max_rows - 1, scroll_offset - drawn_scroll);
+    drawn_scroll = scroll_offset;
+
+    uint32_t id = scroll_offset < rows ? view_at(scroll_offset) : NODE_NONE;
+    for (int i = scroll_offset; id != NODE_NONE && i < rows && i < scroll_offset + max_rows; i++) {
+        render_row(i - scroll_offset, id, i == selected_index);
+        if (i == selected_index)
+            render_details(LINES - 2, id);
+        id = i + 1 < rows ? view_next(id, i + 1) : NODE_NONE;
+    }
+    char exited[96] = "";
+    const ExitRecord *last = &sources.last_exit;
+    if (sources.exits_seen > 0)
+        snprintf(exited, sizeof(exited), "  exits: %llu, last %s [%d] %llu kB peak %.1f ms cpu",
+                 sources.exits_seen, last->comm, last->pid, (unsigned long long)last->peak_rss_kb,
+                 last->cpu_ns / 1e6);
+    screen_put(&screen, LINES - 1, 0, 0, "%d processes, %s view ('s' toggles, 'a' address map, 'd' shared memory)  events: %s%s  tty: %llu B last frame, %d rows redrawn",
+               rows, sort_by_rss ? "by RSS" : "tree", event_sources_name(&sources),
+               exited, screen.bytes_frame, screen.rows_drawn);
+    screen_flush(&screen);
+}
+
+static const char density_glyphs[] = " .:-=+*#%@";
+
+/* Reloads the mapped process at most once per sample period; runs without tree_lock */
+void refresh_map(int pid) {
+    uint64_t now = monotonic_ns();
+    if (space.pid == pid && now - map_loaded_ns < SAMPLE_SECONDS * 1000000000ULL)
+        return;
+    addr_space_load(&space, pid, pages_fd);
+    map_loaded_ns = now;
+}
+
+void map_range(uint64_t *lo, uint64_t *hi) {
+    if (map_hi > map_lo) {
+        *lo = map_lo;
+        *hi = map_hi;
+    } else if (space.count) {
+        *lo = space.vmas[0].start;
+        *hi = space.vmas[space.count - 1].end;
+    } else {
+        *lo = 0;
+        *hi = 1;
+    }
+}
+
+int map_bins() {
+    int cols = COLS - MAP_LABEL, rows = LINES - 4;
+    return cols > 0 && rows > 0 ? cols * rows : 0;
+}
+
+/* Zooms in or out by MAP_ZOOM around the cursor cell, within the mapped span */
+void zoom_map(int in) {
+    uint64_t lo, hi, full_lo, full_hi;
+    int nbins = map_bins();
+    if (!nbins || !space.count) return;
+    map_range(&lo, &hi);
+    uint64_t saved_lo = map_lo, saved_hi = map_hi;
+    map_lo = map_hi = 0;
+    map_range(&full_lo, &full_hi);
+    map_lo = saved_lo;
+    map_hi = saved_hi;
+
+    uint64_t width = (hi - lo - 1) / nbins + 1;
+    uint64_t centre = lo + map_cursor * width + width / 2;
+    uint64_t span = in ? (hi - lo) / MAP_ZOOM : (hi - lo) * MAP_ZOOM;
+    if (in && span < (uint64_t)nbins * 4096)
+        return;     /* already a page per cell */
+    if (!in && span >= full_hi - full_lo) {
+        map_lo = map_hi = 0;
+    } else {
+        map_lo = centre - full_lo > span / 2 ? centre - span / 2 : full_lo;
+        if (map_lo + span > full_hi)
+            map_lo = full_hi - span;
+        map_hi = map_lo + span;
+    }
+    map_range(&lo, &hi);
+    map_cursor = (centre - lo) / ((hi - lo - 1) / nbins + 1);
+}
+
+void format_size(char *buf, size_t size, uint64_t bytes) {
+    const char *units = "KMGTP";
+    double value = bytes / 1024.0;
+    int unit = 0;
+    while (value >= 1024 && units[unit + 1]) {
+        value /= 1024;
+        unit++;
+    }
+    snprintf(buf, size, value < 10 ? "%.1f%c" : "%.0f%c", value, units[unit]);
+}
+
+/* Colour for the permission class, brightness for how much of the bin is resident */
+int bin_attr(const AddrBin *bin) {
+    static const int pairs[ADDR_NR_PERMS] = {
+        [ADDR_PERM_NONE] = PAIR_NOACCESS,
+        [ADDR_PERM_WRITE] = PAIR_WRITE,
+        [ADDR_PERM_EXEC] = PAIR_EXEC,
+    };
+    if (!bin->mapped) return 0;
+    int attr = has_colors() && pairs[bin->perm] ? COLOR_PAIR(pairs[bin->perm]) : 0;
+    if (space.flags & ADDR_RESIDENT) {
+        if (bin->resident * 2 >= bin->mapped)
+            attr |= A_BOLD;
+        else if (bin->resident * 10 < bin->mapped)
+            attr |= A_DIM;
+    }
+    return attr;
+}
+
+/* Caller must hold tree_lock */
+void render_map() {
+    static const char *perm_names[ADDR_NR_PERMS] = { "---", "r--", "rw-", "r-x" };
+    int cols = COLS - MAP_LABEL, nbins = map_bins();
+    if (!nbins) return;
+    if (nbins > bins_cap) {
+        AddrBin *grown = realloc(bins, nbins * sizeof(AddrBin));
+        if (!grown) return;
+        bins = grown;
+        bins_cap = nbins;
+    }
+    if (map_cursor >= nbins)
+        map_cursor = nbins - 1;
+
+    uint64_t lo, hi;
+    AddrStats st;
+    map_range(&lo, &hi);
+    uint64_t width = addr_map_bin(&space, lo, hi, bins, nbins, &st);
+
+    char mapped[16], depth[16], free_text[16], gap[16], cell[16];
+    format_size(mapped, sizeof(mapped), st.mapped);
+    format_size(depth, sizeof(depth), st.mmap_depth);
+    format_size(free_text, sizeof(free_text), st.mmap_free);
+    format_size(gap, sizeof(gap), st.largest_gap);
+    format_size(cell, sizeof(cell), width);
+    uint32_t id = tree_find_pid(&tree, map_pid);
+    screen_put(&screen, 0, 0, A_BOLD,
+               "PID %d %s: %zu VMAs, %s mapped  mmap area%s: %s deep, %s free, largest gap %s at 0x%llx (%.0f%% fragmented)",
+               map_pid, id != NODE_NONE ? tree_name(&tree, id) : "(exited)", st.nr_vmas, mapped,
+               space.flags & ADDR_LAYOUT ? "" : " (estimated)", depth, free_text, gap,
+               (unsigned long long)st.largest_gap_start,
+               st.mmap_free ? 100.0 * (1.0 - (double)st.largest_gap / st.mmap_free) : 0.0);
+    screen_put(&screen, 1, 0, 0,
+               "0x%llx-0x%llx, %s per cell  density \"%s\"  green exec, cyan write, plain read, magenta none%s  +/- zoom, a back",
+               (unsigned long long)lo, (unsigned long long)hi, cell, density_glyphs,
+               space.flags & ADDR_RESIDENT ? ", bold >=50% resident, dim <10%" : ", residency needs mem_tree");
+
+    char text[MAP_LABEL + cols + 1];
+    int attrs[MAP_LABEL + cols];
+    for (int row = 0; row * cols < nbins; row++) {
+        int len = snprintf(text, sizeof(text), "%012llx ", (unsigned long long)(lo + (uint64_t)row * cols * width));
+        for (int i = 0; i < len; i++)
+            attrs[i] = A_DIM;
+        for (int c = 0; c < cols; c++) {
+            const AddrBin *bin = &bins[row * cols + c];
+            int glyph = bin->mapped ? 1 + (int)(bin->mapped * 9 / width > 8 ? 8 : bin->mapped * 9 / width) : 0;
+            text[len + c] = density_glyphs[glyph];
+            attrs[len + c] = bin_attr(bin) | (row * cols + c == map_cursor ? A_REVERSE : 0);
         }
+        screen_put_cells(&screen, row + 2, 0, text, attrs, len + cols);
+    }
+
+    const AddrBin *bin = &bins[map_cursor];
+    uint64_t bin_lo = lo + map_cursor * width;
+    char bin_mapped[16], bin_resident[16];
+    format_size(bin_mapped, sizeof(bin_mapped), bin->mapped);
+    format_size(bin_resident, sizeof(bin_resident), bin->resident);
+    screen_put(&screen, LINES - 2, 0, 0, "0x%llx-0x%llx: %s mapped (%.0f%%), %s resident, %u VMAs, mostly %s",
+               (unsigned long long)bin_lo, (unsigned long long)(bin_lo + width), bin_mapped,
+               100.0 * bin->mapped / width, space.flags & ADDR_RESIDENT ? bin_resident : "?", bin->vmas,
+               bin->mapped ? perm_names[bin->perm] : "unmapped");
+    screen_put(&screen, LINES - 1, 0, 0, "address map of PID %d  tty: %llu B last frame, %d rows redrawn",
+               map_pid, screen.bytes_frame, screen.rows_drawn);
+    screen_flush(&screen);
+}
+
+/* Lists pid's subtree as the tree has it, for the report's /proc fallback; caller must hold tree_lock */
+void list_share_subtree(int pid) {
+    uint32_t root = tree_find_pid(&tree, pid);
+    for (uint32_t id = root; id != NODE_NONE; id = tree_next_preorder(&tree, id, root)) {
+        const ProcessNode *node = &tree.nodes[id];
+        uint32_t parent = node->parent;
+        share_report_add(&report, node->pid, parent != NODE_NONE ? tree.nodes[parent].pid : 0,
+                         node->depth - tree.nodes[root].depth, tree_name(&tree, id));
+    }
+}
+
+/* Rebuilds the report at most once per sample period; runs without tree_lock */
+void refresh_share(int pid) {
+    uint64_t now = monotonic_ns();
+    if (report.pid == pid && now - share_loaded_ns < SAMPLE_SECONDS * 1000000000ULL)
+        return;
+    if (share_report_load(&report, pid, subtree_fd) < 0) {
+        share_report_reset(&report, pid);
+        pthread_mutex_lock(&tree_lock);
+        list_share_subtree(pid);
+        pthread_mutex_unlock(&tree_lock);
+        share_report_read_proc(&report);
+    }
+    share_report_estimate(&report);
+    share_loaded_ns = now;
+}
+
+/* Caller must hold tree_lock */
+void render_share() {
+    const struct mt_subtree_header *t = &report.totals;
+    int kernel = report.flags & SHARE_KERNEL, rows = LINES - 3;
+    char rss[16], pss[16], uss[16], inside[16], outside[16], swap[16], pgtables[16], cost[16], worker[16], worker_rss[16];
+    format_size(rss, sizeof(rss), t->rss_kb * 1024);
+    format_size(pss, sizeof(pss), t->pss_kb * 1024);
+    format_size(uss, sizeof(uss), t->uss_kb * 1024);
+    format_size(inside, sizeof(inside), t->inside_kb * 1024);
+    format_size(outside, sizeof(outside), t->outside_kb * 1024);
+    format_size(swap, sizeof(swap), t->swap_kb * 1024);
+    format_size(pgtables, sizeof(pgtables), t->pgtables_kb * 1024);
+    /* without the module, PSS is the nearest thing to the subtree's own cost */
+    uint64_t cost_kb = kernel ? t->uss_kb + t->inside_kb : t->pss_kb;
+    format_size(cost, sizeof(cost), cost_kb * 1024);
+
+    const char *root = report.count ? report.procs[0].comm : "(exited)";
+    const char *denied = t->flags & MT_SUBTREE_DENIED ? "  some processes not readable" : "";
+    if (kernel)
+        screen_put(&screen, 0, 0, A_BOLD,
+                   "PID %d %s: %zu processes  RSS summed %s  PSS %s  USS %s  shared inside %s, outside %s%s  swap %s%s",
+                   share_pid, root, report.count, rss, pss, uss, inside, outside,
+                   t->flags & MT_SUBTREE_PARTIAL ? " (partial)" : "", swap, denied);
+    else
+        screen_put(&screen, 0, 0, A_BOLD,
+                   "PID %d %s: %zu processes  RSS summed %s  PSS %s  USS %s  swap %s%s  (mem_tree gives the inside/outside split)",
+                   share_pid, root, report.count, rss, pss, uss, swap, denied);
+
+    char cost_line[256];
+    int len = snprintf(cost_line, sizeof(cost_line), "subtree costs %s%s (%.0f%% of summed RSS) + %s page tables",
+                       kernel ? "" : "~", cost, t->rss_kb ? 100.0 * cost_kb / t->rss_kb : 0.0, pgtables);
+    if (report.workers) {
+        format_size(worker, sizeof(worker), report.worker_kb * 1024);
+        format_size(worker_rss, sizeof(worker_rss), report.worker_rss_kb * 1024);
+        snprintf(cost_line + len, sizeof(cost_line) - len, "  one more %s (of %u) adds ~%s, not its %s RSS",
+                 report.worker_comm, report.workers, worker, worker_rss);
+    } else {
+        snprintf(cost_line + len, sizeof(cost_line) - len, "  no worker pool among the children");
+    }
+    screen_put(&screen, 1, 0, 0, "%s", cost_line);
+
+    if (share_scroll > (int)report.count - rows)
+        share_scroll = (int)report.count > rows ? (int)report.count - rows : 0;
+    for (int row = 0; row < rows; row++) {
+        size_t i = share_scroll + row;
+        if (i >= report.count) {
+            screen_put(&screen, row + 2, 0, 0, "");
+            continue;
+        }
+        const struct mt_share *rec = &report.procs[i];
+        if (rec->flags & MT_SHARE_DENIED) {
+            screen_put(&screen, row + 2, rec->depth * 2, A_DIM, "%.16s [PID: %d] not readable", rec->comm, rec->pid);
+            continue;
+        }
+        format_size(rss, sizeof(rss), rec->rss_kb * 1024);
+        format_size(pss, sizeof(pss), rec->pss_kb * 1024);
+        format_size(uss, sizeof(uss), rec->uss_kb * 1024);
+        format_size(inside, sizeof(inside), rec->shared_kb * 1024);
+        format_size(swap, sizeof(swap), rec->swap_kb * 1024);
+        format_size(pgtables, sizeof(pgtables), rec->pgtables_kb * 1024);
+        screen_put(&screen, row + 2, rec->depth * 2, 0,
+                   "%.16s [PID: %d] RSS %s  PSS %s  USS %s  shared %s  swap %s  pgtables %s",
+                   rec->comm, rec->pid, rss, pss, uss, inside, swap, pgtables);
+    }
+    screen_put(&screen, LINES - 1, 0, 0, "shared memory of PID %d's subtree  up/down scroll, d back  tty: %llu B last frame, %d rows redrawn",
+               share_pid, screen.bytes_frame, screen.rows_drawn);
+    screen_flush(&screen);
+}
+
+/* Caller must hold tree_lock */
+void handle_share_key(int ch) {
+    switch (ch) {
+        case KEY_UP:
+            if (share_scroll > 0) share_scroll--;
+            break;
+        case KEY_DOWN:
+            share_scroll++;
+            break;
+        case 'd':
+            share_pid = 0;
+            drawn_scroll = scroll_offset;
+            screen_resize(&screen);
+            break;
+        case KEY_RESIZE:
+            screen_resize(&screen);
+            break;
+    }
+}
+
+/* Caller must hold tree_lock */
+void handle_map_key(int ch) {
+    int cols = COLS - MAP_LABEL, nbins = map_bins();
+    switch (ch) {
+        case KEY_LEFT:
+            if (map_cursor > 0) map_cursor--;
+            break;
+        case KEY_RIGHT:
+            if (map_cursor < nbins - 1) map_cursor++;
+            break;
+        case KEY_UP:
+            if (map_cursor >= cols) map_cursor -= cols;
+            break;
+        case KEY_DOWN:
+            if (map_cursor + cols < nbins) map_cursor += cols;
+            break;
+        case '+':
+            zoom_map(1);
+            break;
+        case '-':
+            zoom_map(0);
+            break;
+        case 'a':
+            map_pid = 0;
+            drawn_scroll = scroll_offset;
+            screen_resize(&screen);
+            break;
+        case KEY_RESIZE:
+            screen_resize(&screen);
+            break;
+    }
+}
+
+/* Caller must hold tree_lock */
+void handle_list_key(int ch) {
+    switch (ch) {
+        case KEY_UP:
+            if (selected_index > 0) selected_index--;
+            break;
+        case KEY_DOWN:
+            selected_index++;
+            break;
+        case '\n':
+            if (!sort_by_rss && (uint32_t)selected_index < tree.visible_rows) {
+                uint32_t id = tree_visible_at(&tree, selected_index);
+                tree_set_collapsed(&tree, id, !tree.nodes[id].collapsed);
+            }
+            break;
+        case 's':
+            sort_by_rss = !sort_by_rss;
+            selected_index = 0;
+            break;
+        case 'a':
+            if (selected_index < view_rows()) {
+                map_pid = tree.nodes[view_at(selected_index)].pid;
+                map_lo = map_hi = 0;
+                map_cursor = 0;
+                screen_resize(&screen);
+            }
+            break;
+        case 'd':
+            if (selected_index < view_rows()) {
+                share_pid = tree.nodes[view_at(selected_index)].pid;
+                share_scroll = 0;
+                screen_resize(&screen);
+            }
+            break;
+        case KEY_RESIZE:
+            screen_resize(&screen);
+            break;
     }
-    return NULL;
 }
 
 int main() {
-    initscr();
+    tree_init(&tree);
+    if (event_sources_open(&sources, &tree) < 0) {
+        fprintf(stderr, "Failed to load the process tree\n");
+        return 1;
+    }
+    summary_fd = open("/proc/" MT_PROC_DIR "/" MT_SUMMARY_FILE, O_RDWR | O_CLOEXEC);
+    pages_fd = open("/proc/" MT_PROC_DIR "/" MT_PAGES_FILE, O_RDWR | O_CLOEXEC);
+    subtree_fd = open("/proc/" MT_PROC_DIR "/" MT_SUBTREE_FILE, O_RDWR | O_CLOEXEC);
+
+    if (screen_open(&screen) < 0) {
+        fprintf(stderr, "Failed to initialise the terminal\n");
+        return 1;
+    }
     noecho();
     cbreak();
     keypad(stdscr, TRUE);
+    timeout(REDRAW_MS);
+    if (has_colors()) {
+        start_color();
+        use_default_colors();
+        init_pair(PAIR_GROWING, COLOR_YELLOW, -1);
+        init_pair(PAIR_FAULTING, COLOR_RED, -1);
+        init_pair(PAIR_EXEC, COLOR_GREEN, -1);
+        init_pair(PAIR_WRITE, COLOR_CYAN, -1);
+        init_pair(PAIR_NOACCESS, COLOR_MAGENTA, -1);
+    }
+
+    sampler_set_memory(1);
+    sampler_set_interval(SAMPLE_SECONDS * 1000);
+    if (sampler_start(&tree, &tree_lock, sysconf(_SC_NPROCESSORS_ONLN)) < 0) {
+        screen_close(&screen);
+        fprintf(stderr, "Error creating sampler threads\n");
+        return 1;
+    }
+    sampler_kick();     /* the first sweep shouldn't wait a whole interval */
 
+    /* without the pipe the update thread still sees stopping by its next poll */
+    if (pipe(wake_pipe) < 0)
+        wake_pipe[0] = wake_pipe[1] = -1;
     pthread_t update_thread;
     pthread_create(&update_thread, NULL, update_thread_func, NULL);
 
-    int ch;
-    while ((ch = getch()) != 'q') {
-        switch (ch) {
-            case KEY_UP:
-                if (selected_index > 0) selected_index--;
-                break;
-            case KEY_DOWN:
-                if (selected_index < visible_count - 1) selected_index++;
-                break;
-            case '\n':
-                if (selected_index < visible_count)
-                    visible_nodes[selected_index]->collapsed = !visible_nodes[selected_index]->collapsed;
-                flatten_tree();
-                break;
-        }
-        render_process_tree();
-    }
+    int ch = ERR;
+    do {
+        pthread_mutex_lock(&tree_lock);
+        if (map_pid)
+            handle_map_key(ch);
+        else if (share_pid)
+            handle_share_key(ch);
+        else
+            handle_list_key(ch);
+        int pid = map_pid, share = share_pid;
+        pthread_mutex_unlock(&tree_lock);
+
+        /* the page walks behind a map or report can be long; the sampler shouldn't wait on them */
+        if (pid)
+            refresh_map(pid);
+        else if (share)
+            refresh_share(share);
+
+        pthread_mutex_lock(&tree_lock);
+        if (map_pid)
+            render_map();
+        else if (share_pid)
+            render_share();
+        else
+            render_process_tree();
+        pthread_mutex_unlock(&tree_lock);
+    } while ((ch = getch()) != 'q');
 
-    pthread_cancel(update_thread);
+    /* the update thread finishes its current step, so it never stops holding tree_lock */
+    atomic_store(&stopping, 1);
+    if (wake_pipe[1] >= 0)
+        close(wake_pipe[1]);    /* hangs up the read end, ending the wait */
     pthread_join(update_thread, NULL);
-    endwin();
+    sampler_stop();
+    if (wake_pipe[0] >= 0)
+        close(wake_pipe[0]);
+    screen_close(&screen);
+    if (summary_fd >= 0)
+        close(summary_fd);
+    if (pages_fd >= 0)
+        close(pages_fd);
+    if (subtree_fd >= 0)
+        close(subtree_fd);
+    share_report_free(&report);
+    event_sources_close(&sources);
+    addr_space_free(&space);
+    free(bins);
+    tree_free(&tree);
     return 0;
 }
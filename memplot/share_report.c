@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "share_report.h"
+
+#define SUBTREE_CHUNK (16 * 1024)
+
+static int reserve_procs(ShareReport *r, size_t count) {
+    if (count <= r->cap) return 0;
+    size_t cap = r->cap ? r->cap : 64;
+    while (cap < count)
+        cap *= 2;
+    struct mt_share *grown = realloc(r->procs, cap * sizeof(*grown));
+    if (!grown) return -1;
+    r->procs = grown;
+    r->cap = cap;
+    return 0;
+}
+
+void share_report_reset(ShareReport *r, int pid) {
+    r->pid = pid;
+    r->flags = 0;
+    r->count = 0;
+    memset(&r->totals, 0, sizeof(r->totals));
+    r->totals.pid = pid;
+    r->worker_comm[0] = '\0';
+    r->workers = 0;
+    r->worker_kb = r->worker_rss_kb = 0;
+}
+
+/* One snapshot from /proc/mem_tree/subtree; fd is open read-write */
+int share_report_load(ShareReport *r, int pid, int fd) {
+    share_report_reset(r, pid);
+    char pid_text[16];
+    int len = snprintf(pid_text, sizeof(pid_text), "%d", pid);
+    if (fd < 0 || write(fd, pid_text, len) != len)
+        return -1;
+
+    size_t size = 0, cap = SUBTREE_CHUNK;
+    char *buf = malloc(cap);
+    ssize_t n;
+    while (buf && (n = pread(fd, buf + size, cap - size, size)) > 0) {
+        size += n;
+        if (size == cap) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) {
+                free(buf);
+                buf = NULL;
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+    }
+
+    struct mt_subtree_header hdr;
+    if (!buf || size < sizeof(hdr)) {
+        free(buf);
+        return -1;
+    }
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.magic != MT_SUBTREE_MAGIC || hdr.record_size != sizeof(struct mt_share) ||
+        hdr.header_size < sizeof(hdr) || hdr.header_size > size || hdr.pid != pid) {
+        free(buf);
+        return -1;
+    }
+
+    size_t count = (size - hdr.header_size) / hdr.record_size;
+    if (count > hdr.count)
+        count = hdr.count;
+    if (reserve_procs(r, count) < 0) {
+        free(buf);
+        return -1;
+    }
+    memcpy(r->procs, buf + hdr.header_size, count * sizeof(struct mt_share));
+    r->count = count;
+    r->totals = hdr;
+    r->flags = SHARE_KERNEL;
+    free(buf);
+    return 0;
+}
+
+int share_report_add(ShareReport *r, int pid, int ppid, int depth, const char *comm) {
+    if (reserve_procs(r, r->count + 1) < 0)
+        return -1;
+    struct mt_share *rec = &r->procs[r->count++];
+    memset(rec, 0, sizeof(*rec));
+    rec->pid = pid;
+    rec->ppid = ppid;
+    rec->depth = depth;
+    strncpy(rec->comm, comm, sizeof(rec->comm) - 1);
+    return 0;
+}
+
+static int read_text(const char *path, char *buf, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t len = read(fd, buf, size - 1);
+    close(fd);
+    if (len < 0) return -1;
+    buf[len] = '\0';
+    return 0;
+}
+
+/* The kB value on the line starting with key, or 0 */
+static uint64_t field_kb(const char *buf, const char *key) {
+    size_t key_len = strlen(key);
+    for (const char *line = buf; line; line = strchr(line, '\n')) {
+        if (*line == '\n')
+            line++;
+        if (strncmp(line, key, key_len) == 0)
+            return strtoull(line + key_len, NULL, 10);
+    }
+    return 0;
+}
+
+/* Fills every listed process from smaps_rollup; exited ones stay at zero */
+void share_report_read_proc(ShareReport *r) {
+    char path[64], buf[4096];
+    struct mt_subtree_header *t = &r->totals;
+    for (size_t i = 0; i < r->count; i++) {
+        struct mt_share *rec = &r->procs[i];
+        snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", rec->pid);
+        if (read_text(path, buf, sizeof(buf)) == 0) {
+            rec->rss_kb = field_kb(buf, "Rss:");
+            rec->pss_kb = field_kb(buf, "Pss:");
+            rec->uss_kb = field_kb(buf, "Private_Clean:") + field_kb(buf, "Private_Dirty:");
+            rec->shared_kb = field_kb(buf, "Shared_Clean:") + field_kb(buf, "Shared_Dirty:");
+            rec->swap_kb = field_kb(buf, "Swap:");
+        } else if (errno == EACCES) {
+            rec->flags |= MT_SHARE_DENIED;
+            t->flags |= MT_SUBTREE_DENIED;
+        }
+        snprintf(path, sizeof(path), "/proc/%d/status", rec->pid);
+        if (read_text(path, buf, sizeof(buf)) == 0)
+            rec->pgtables_kb = field_kb(buf, "VmPTE:");
+
+        t->rss_kb += rec->rss_kb;
+        t->pss_kb += rec->pss_kb;
+        t->uss_kb += rec->uss_kb;
+        t->swap_kb += rec->swap_kb;
+        t->pgtables_kb += rec->pgtables_kb;
+    }
+    t->count = r->count;
+}
+
+static const struct mt_share *sort_base;
+
+static int compare_comm(const void *a, const void *b) {
+    return strncmp(sort_base[*(const size_t *)a].comm, sort_base[*(const size_t *)b].comm,
+                   sizeof(sort_base->comm));
+}
+
+void share_report_estimate(ShareReport *r) {
+    r->worker_comm[0] = '\0';
+    r->workers = 0;
+    r->worker_kb = r->worker_rss_kb = 0;
+
+    size_t *children = malloc((r->count ? r->count : 1) * sizeof(size_t)), nr = 0;
+    if (!children) return;
+    for (size_t i = 0; i < r->count; i++)
+        if (r->procs[i].depth == 1 && !(r->procs[i].flags & MT_SHARE_DENIED))
+            children[nr++] = i;
+    sort_base = r->procs;
+    qsort(children, nr, sizeof(size_t), compare_comm);
+
+    size_t best = 0, best_len = 0;
+    for (size_t i = 0, run; i < nr; i += run) {
+        for (run = 1; i + run < nr && compare_comm(&children[i], &children[i + run]) == 0; run++)
+            ;
+        if (run > best_len) {
+            best = i;
+            best_len = run;
+        }
+    }
+    if (best_len >= 2) {
+        uint64_t cost = 0, rss = 0;
+        for (size_t i = best; i < best + best_len; i++) {
+            const struct mt_share *rec = &r->procs[children[i]];
+            cost += rec->uss_kb + rec->pgtables_kb;
+            rss += rec->rss_kb;
+        }
+        memcpy(r->worker_comm, r->procs[children[best]].comm, sizeof(r->worker_comm));
+        r->worker_comm[sizeof(r->worker_comm) - 1] = '\0';
+        r->workers = best_len;
+        r->worker_kb = cost / best_len;
+        r->worker_rss_kb = rss / best_len;
+    }
+    free(children);
+}
+
+void share_report_free(ShareReport *r) {
+    free(r->procs);
+    memset(r, 0, sizeof(*r));
+}
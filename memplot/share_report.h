@@ -0,0 +1,46 @@
+#ifndef SHARE_REPORT_H
+#define SHARE_REPORT_H
+
+/*
+ * Shared-memory report for one process subtree. With the module loaded
+ * the whole report comes from /proc/mem_tree/subtree, which also knows
+ * which shared pages never leave the subtree. Without it, the caller
+ * lists the subtree with share_report_add() and share_report_read_proc()
+ * fills each process in from /proc/<pid>/smaps_rollup and status; the
+ * inside/outside split is then unknown and PSS stands in for the
+ * subtree's cost.
+ *
+ * share_report_estimate() prices one more worker: the root's children
+ * are grouped by name, and the largest group of two or more is taken to
+ * be the worker pool. A worker's own pages and page tables are what a
+ * new one adds; what it shares with its siblings is already paid for.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mem_tree.h"
+
+#define SHARE_KERNEL  0x1       /* from mem_tree: inside_kb and outside_kb are real */
+
+typedef struct ShareReport {
+    int pid;
+    int flags;
+    struct mt_subtree_header totals;
+    struct mt_share *procs;     /* pre-order from the root */
+    size_t count;
+    size_t cap;
+    char worker_comm[16];       /* empty when no worker pool was found */
+    uint32_t workers;
+    uint64_t worker_kb;         /* mean USS plus page tables of one worker */
+    uint64_t worker_rss_kb;     /* mean RSS, what summing RSS would charge */
+} ShareReport;
+
+int share_report_load(ShareReport *r, int pid, int subtree_fd);
+void share_report_reset(ShareReport *r, int pid);
+int share_report_add(ShareReport *r, int pid, int ppid, int depth, const char *comm);
+void share_report_read_proc(ShareReport *r);
+void share_report_estimate(ShareReport *r);
+void share_report_free(ShareReport *r);
+
+#endif
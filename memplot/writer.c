@@ -8,34 +8,106 @@
 #include <linux/mm.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
+#include <linux/pid.h>
+#include <linux/ptrace.h>
+#include <linux/mmap_lock.h>
+#include <linux/sched/mm.h>
+#include <linux/pagewalk.h>
+#include <linux/huge_mm.h>
+#include <linux/swapops.h>
+#include <linux/xarray.h>
+#include <linux/log2.h>
+
+#include "mem_tree.h"
+#include "../_ps_plus/task_walk.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Uday Gopan");
-MODULE_DESCRIPTION("Kernel module to display all processes and their memory maps in /proc/mem_tree/");
-MODULE_VERSION("0.4");
+MODULE_DESCRIPTION("Kernel module to display process memory maps through /proc/mem_tree/map");
+MODULE_VERSION("0.7");
 
-#define PROC_DIR "mem_tree"
+#define PROC_DIR MT_PROC_DIR
+#define MAP_FILE "map"
 
 struct proc_dir_entry *proc_mem_tree;
 
+/*
+ * /proc/mem_tree/map: each open file selects its own process by writing
+ * a pid, then reads that process's memory map. The pid is resolved when
+ * it is written and again on every read, so nothing is set up per
+ * process at load time and an exited process reads as ESRCH, never as a
+ * stale task. /proc/mem_tree/summary, pages and subtree select their
+ * process the same way; subtree takes the pid as the root of a tree.
+ * A pid is only accepted, and only read, if the reader could read its
+ * /proc/<pid>/maps: the same ptrace read check guards both.
+ */
+struct map_target {
+    struct pid *pid;
+    struct mt_vma *vmas;    /* pages file only: the snapshot being read */
+    size_t count;
+    struct mt_pages_header layout;  /* pages file only: the snapshot's mm layout */
+};
+
+/* The task behind pid if the reader may inspect it; put_task_struct() when done */
+static struct task_struct *get_readable_task(struct pid *pid, enum pid_type type)
+{
+    struct task_struct *task = get_pid_task(pid, type);
+
+    if (!task)
+        return ERR_PTR(-ESRCH);
+    if (!ptrace_may_access(task, PTRACE_MODE_READ_FSCREDS)) {
+        put_task_struct(task);
+        return ERR_PTR(-EACCES);
+    }
+    return task;
+}
+
+/*
+ * Returns the target's mm with mmap_read_lock held, NULL if it has no
+ * mm (a kernel thread), or an ERR_PTR. Release with unlock_target_mm().
+ */
+static struct mm_struct *lock_target_mm(struct map_target *target)
+{
+    struct task_struct *task;
+    struct mm_struct *mm;
+
+    if (!target->pid)
+        return ERR_PTR(-EINVAL);
+
+    task = get_readable_task(target->pid, PIDTYPE_PID);
+    if (IS_ERR(task))
+        return ERR_CAST(task);
+    mm = get_task_mm(task);
+    put_task_struct(task);
+    if (mm && mmap_read_lock_killable(mm)) {
+        mmput(mm);
+        return ERR_PTR(-EINTR);
+    }
+    return mm;
+}
+
+static void unlock_target_mm(struct mm_struct *mm)
+{
+    mmap_read_unlock(mm);
+    mmput(mm);
+}
+
 /* Function to print the memory map of a process */
 static int mem_map_show(struct seq_file *m, void *v)
 {
-    struct task_struct *task = m->private;
-    struct mm_struct *mm;
+    struct map_target *target = m->private;
+    struct mm_struct *mm = lock_target_mm(target);
     struct vm_area_struct *vma;
     struct vma_iterator vmi;
 
-    if (!task)
-        return -ENOENT;
-
-    mm = get_task_mm(task);
+    if (IS_ERR(mm))
+        return PTR_ERR(mm);
     if (!mm) {
-        seq_printf(m, "No memory map available for PID %d\n", task->pid);
+        seq_printf(m, "No memory map available for PID %d\n", pid_vnr(target->pid));
         return 0;
     }
 
-    seq_printf(m, "Memory map for PID %d:\n", task->pid);
+    seq_printf(m, "Memory map for PID %d:\n", pid_vnr(target->pid));
 
     vma_iter_init(&vmi, mm, 0);
     while ((vma = vma_next(&vmi))) {
@@ -43,30 +115,657 @@ static int mem_map_show(struct seq_file *m, void *v)
                    vma->vm_start, vma->vm_end, vma->vm_flags);
     }
 
+    unlock_target_mm(mm);
+    return 0;
+}
+
+/* Same tests as /proc/<pid>/maps uses to label [heap] and [stack] */
+static int vma_category(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+    if (vma->vm_start <= mm->start_stack && vma->vm_end >= mm->start_stack)
+        return MT_STACK;
+    if (vma->vm_start <= mm->brk && vma->vm_end >= mm->start_brk)
+        return MT_HEAP;
+    if (vma->vm_flags & VM_MAYSHARE)
+        return MT_SHARED;
+    if (vma->vm_file)
+        return MT_FILE;
+    return MT_ANON;
+}
+
+/* One fixed record per read: per-category VMA totals plus the mm counters */
+static int mem_summary_show(struct seq_file *m, void *v)
+{
+    struct map_target *target = m->private;
+    struct mm_struct *mm = lock_target_mm(target);
+    struct mt_summary rec = {
+        .magic   = MT_SUMMARY_MAGIC,
+        .version = MT_VERSION,
+        .size    = sizeof(rec),
+    };
+    struct vm_area_struct *vma;
+    struct vma_iterator vmi;
+    unsigned long kb;
+    int cat;
+
+    if (IS_ERR(mm))
+        return PTR_ERR(mm);
+    rec.pid = pid_vnr(target->pid);
+    if (!mm) {
+        seq_write(m, &rec, sizeof(rec));
+        return 0;
+    }
+
+    vma_iter_init(&vmi, mm, 0);
+    while ((vma = vma_next(&vmi))) {
+        kb = (vma->vm_end - vma->vm_start) >> 10;
+        cat = vma_category(mm, vma);
+        rec.vm_kb[cat] += kb;
+        rec.vmas[cat]++;
+        if (vma->vm_flags & VM_EXEC) {
+            rec.vm_kb[MT_EXEC] += kb;
+            rec.vmas[MT_EXEC]++;
+        }
+        rec.nr_vmas++;
+        rec.total_vm_kb += kb;
+    }
+
+    rec.rss_anon_kb = get_mm_counter(mm, MM_ANONPAGES) << (PAGE_SHIFT - 10);
+    rec.rss_file_kb = get_mm_counter(mm, MM_FILEPAGES) << (PAGE_SHIFT - 10);
+    rec.rss_shmem_kb = get_mm_counter(mm, MM_SHMEMPAGES) << (PAGE_SHIFT - 10);
+    rec.swap_kb = get_mm_counter(mm, MM_SWAPENTS) << (PAGE_SHIFT - 10);
+    rec.hiwater_rss_kb = get_mm_hiwater_rss(mm) << (PAGE_SHIFT - 10);
+    rec.pgtables_kb = mm_pgtables_bytes(mm) >> 10;
+    unlock_target_mm(mm);
+
+    seq_write(m, &rec, sizeof(rec));
+    return 0;
+}
+
+#define PSS_SHIFT 12    /* fixed point for the PSS shares, as in smaps */
+
+/*
+ * Pages with more than one mapper seen during a subtree walk, keyed by
+ * pfn. Each value packs how many of the walk's mappings reached the
+ * page, how many mappers it had when first seen, and its order; both
+ * counts saturate.
+ */
+#define SHARE_BITS          (BITS_PER_LONG == 64 ? 24 : 13)
+#define SHARE_MASK          ((1UL << SHARE_BITS) - 1)
+#define SHARE_PACK(count, sharers, order) \
+    ((count) | ((unsigned long)(sharers) << SHARE_BITS) | ((unsigned long)(order) << (2 * SHARE_BITS)))
+#define SHARE_COUNT(v)      ((v) & SHARE_MASK)
+#define SHARE_SHARERS(v)    (((v) >> SHARE_BITS) & SHARE_MASK)
+#define SHARE_ORDER(v)      ((v) >> (2 * SHARE_BITS))
+
+struct share_pending {
+    unsigned long pfn;
+    unsigned int sharers;
+    unsigned int order;
+};
+
+/*
+ * Shared pages are queued while the PTE lock is held and moved into the
+ * xarray once it is dropped, where allocating may sleep. One PMD's worth
+ * of queue is enough since the walk drains it after every PMD.
+ */
+struct share_table {
+    struct xarray pages;
+    bool partial;
+    unsigned int nr_pending;
+    struct share_pending pending[PTRS_PER_PTE];
+};
+
+/* Page counts for one VMA, accumulated by the page table walk */
+struct page_counts {
+    struct mt_vma *rec;
+    u64 pss;            /* bytes << PSS_SHIFT */
+    struct share_table *share;  /* subtree walks only */
+};
+
+/*
+ * How many mappings share the nr pages at page. A PMD maps the whole
+ * folio at once, so its mapcount is already per mapping, as smaps counts
+ * it; only a PTE-mapped large folio is averaged over its pages.
+ */
+static int page_sharers(struct page *page, unsigned long nr)
+{
+    struct folio *folio = page_folio(page);
+    int mapcount = folio_mapcount(folio);
+
+    if (folio_test_large(folio) && nr == 1)
+        mapcount = DIV_ROUND_UP(mapcount, folio_nr_pages(folio));
+    return max(mapcount, 1);
+}
+
+static void share_queue(struct share_table *s, struct page *page, int sharers, unsigned long nr)
+{
+    struct share_pending *p;
+
+    if (s->nr_pending == ARRAY_SIZE(s->pending)) {
+        s->partial = true;
+        return;
+    }
+    p = &s->pending[s->nr_pending++];
+    p->pfn = page_to_pfn(page);
+    p->sharers = min_t(unsigned long, sharers, SHARE_MASK);
+    p->order = ilog2(nr);
+}
+
+/* Called with only the mmap lock held */
+static void share_flush(struct share_table *s)
+{
+    struct share_pending *p;
+    unsigned long v;
+    void *old;
+
+    for (p = s->pending; p < s->pending + s->nr_pending; p++) {
+        old = xa_load(&s->pages, p->pfn);
+        v = old ? xa_to_value(old) : SHARE_PACK(0, p->sharers, p->order);
+        if (SHARE_COUNT(v) < SHARE_MASK)
+            v++;
+        if (xa_is_err(xa_store(&s->pages, p->pfn, xa_mk_value(v), GFP_KERNEL)))
+            s->partial = true;
+    }
+    s->nr_pending = 0;
+}
+
+static void count_pages(struct page_counts *c, struct page *page, unsigned long nr, bool dirty)
+{
+    unsigned long kb = nr << (PAGE_SHIFT - 10);
+    int sharers = page_sharers(page, nr);
+
+    c->rec->present_kb += kb;
+    if (dirty)
+        c->rec->dirty_kb += kb;
+    if (sharers > 1) {
+        c->rec->shared_kb += kb;
+        if (c->share)
+            share_queue(c->share, page, sharers, nr);
+    }
+    c->pss += ((u64)nr << (PAGE_SHIFT + PSS_SHIFT)) / sharers;
+}
+
+static int count_pmd(pmd_t *pmd, unsigned long addr, unsigned long end, struct mm_walk *walk)
+{
+    struct page_counts *c = walk->private;
+    struct vm_area_struct *vma = walk->vma;
+    struct page *page;
+    pte_t *start, *pte;
+    spinlock_t *ptl;
+
+    ptl = pmd_trans_huge_lock(pmd, vma);
+    if (ptl) {
+        /* the huge zero page and special mappings have no page of their own to count */
+        page = pmd_present(*pmd) ? vm_normal_page_pmd(vma, addr, *pmd) : NULL;
+        if (page) {
+            count_pages(c, page, HPAGE_PMD_NR, pmd_dirty(*pmd));
+            c->rec->thp_kb += HPAGE_PMD_SIZE >> 10;
+        }
+        spin_unlock(ptl);
+        goto out;
+    }
+
+    start = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+    if (!pte) {
+        walk->action = ACTION_AGAIN;
+        return 0;
+    }
+    for (; addr != end; pte++, addr += PAGE_SIZE) {
+        pte_t ptent = ptep_get(pte);
+
+        if (pte_present(ptent)) {
+            page = vm_normal_page(vma, addr, ptent);
+            if (page)
+                count_pages(c, page, 1, pte_dirty(ptent));
+        } else if (is_swap_pte(ptent) && !non_swap_entry(pte_to_swp_entry(ptent)))
+            c->rec->swap_kb += PAGE_SIZE >> 10;
+    }
+    pte_unmap_unlock(start, ptl);
+out:
+    if (c->share)
+        share_flush(c->share);
+    /* the mmap lock is held across the whole address space; let others run */
+    cond_resched();
+    return 0;
+}
+
+static const struct mm_walk_ops count_ops = {
+    .pmd_entry = count_pmd,
+    .walk_lock = PGWALK_RDLOCK,
+};
+
+/* Fills target->vmas from one pass over the address space under one lock */
+static int snapshot_pages(struct map_target *target)
+{
+    struct mm_struct *mm = lock_target_mm(target);
+    struct vm_area_struct *vma;
+    struct vma_iterator vmi;
+    struct page_counts c = { .share = NULL };
+    size_t cap;
+
+    target->count = 0;
+    memset(&target->layout, 0, sizeof(target->layout));
+    if (IS_ERR(mm))
+        return PTR_ERR(mm);
+    if (!mm)
+        return 0;
+
+    /* map_count can't change while the lock is held */
+    cap = mm->map_count;
+    kvfree(target->vmas);
+    target->vmas = kvmalloc_array(max_t(size_t, cap, 1), sizeof(*target->vmas), GFP_KERNEL);
+    if (!target->vmas) {
+        unlock_target_mm(mm);
+        return -ENOMEM;
+    }
+
+    target->layout.mmap_base = mm->mmap_base;
+    target->layout.start_brk = mm->start_brk;
+    target->layout.brk = mm->brk;
+    target->layout.start_stack = mm->start_stack;
+
+    vma_iter_init(&vmi, mm, 0);
+    while ((vma = vma_next(&vmi)) && target->count < cap) {
+        c.rec = &target->vmas[target->count++];
+        c.pss = 0;
+        memset(c.rec, 0, sizeof(*c.rec));
+        c.rec->start = vma->vm_start;
+        c.rec->end = vma->vm_end;
+        c.rec->flags = vma->vm_flags;
+        walk_page_range(mm, vma->vm_start, vma->vm_end, &count_ops, &c);
+        c.rec->pss_kb = c.pss >> (PSS_SHIFT + 10);
+    }
+    unlock_target_mm(mm);
+    return 0;
+}
+
+static void *pages_start(struct seq_file *m, loff_t *pos)
+{
+    struct map_target *target = m->private;
+    int err;
+
+    if (*pos == 0) {
+        err = snapshot_pages(target);
+        return err ? ERR_PTR(err) : SEQ_START_TOKEN;
+    }
+    return *pos <= target->count ? &target->vmas[*pos - 1] : NULL;
+}
+
+static void *pages_next(struct seq_file *m, void *v, loff_t *pos)
+{
+    struct map_target *target = m->private;
+
+    (*pos)++;
+    return *pos <= target->count ? &target->vmas[*pos - 1] : NULL;
+}
+
+static void pages_stop(struct seq_file *m, void *v)
+{
+}
+
+static int pages_show(struct seq_file *m, void *v)
+{
+    struct map_target *target = m->private;
+    struct mt_pages_header hdr;
+
+    if (v == SEQ_START_TOKEN) {
+        hdr = target->layout;
+        hdr.magic = MT_PAGES_MAGIC;
+        hdr.version = MT_VERSION;
+        hdr.header_size = sizeof(hdr);
+        hdr.record_size = sizeof(struct mt_vma);
+        hdr.pid = pid_vnr(target->pid);
+        hdr.count = target->count;
+        seq_write(m, &hdr, sizeof(hdr));
+        return 0;
+    }
+    seq_write(m, v, sizeof(struct mt_vma));
+    return 0;
+}
+
+static const struct seq_operations pages_seq_ops = {
+    .start = pages_start,
+    .next  = pages_next,
+    .stop  = pages_stop,
+    .show  = pages_show
+};
+
+/*
+ * /proc/mem_tree/subtree: one process tree walked as a whole. The
+ * snapshot holds a reference on each process's struct pid from the time
+ * the tree is listed until the file is read again or closed.
+ */
+struct subtree_proc {
+    struct pid *pid;
+    struct mt_share rec;
+};
+
+struct subtree_target {
+    struct map_target target;   /* first, so mem_map_write() can select the root */
+    struct subtree_proc *procs;
+    size_t count;
+    struct mt_subtree_header hdr;
+};
+
+#define SUBTREE_SLACK 64    /* room for forks between counting and listing */
+
+/* Lists up to max processes of the subtree into out; returns how many there are */
+static size_t list_subtree(struct pid *root_pid, struct subtree_proc *out, size_t max)
+{
+    struct task_struct *root, *task;
+    size_t n = 0;
+    int depth = 0;
+
+    rcu_read_lock();
+    root = pid_task(root_pid, PIDTYPE_TGID);
+    for (task = root; task; task = task_walk_next(root, task, &depth), n++) {
+        if (n >= max)
+            continue;
+        out[n].pid = get_pid(task_tgid(task));
+        out[n].rec.pid = task_tgid_vnr(task);
+        out[n].rec.ppid = task == root ? 0 : task_tgid_vnr(rcu_dereference(task->real_parent));
+        out[n].rec.depth = depth;
+        get_task_comm(out[n].rec.comm, task);
+    }
+    rcu_read_unlock();
+    return n;
+}
+
+/* Walks one process's page tables, adding its shared pages to share */
+static int walk_share(struct subtree_proc *p, struct share_table *share)
+{
+    struct task_struct *task = get_readable_task(p->pid, PIDTYPE_TGID);
+    struct mt_vma counts = { 0 };
+    struct page_counts c = { .rec = &counts, .share = share };
+    struct vm_area_struct *vma;
+    struct vma_iterator vmi;
+    struct mm_struct *mm;
+
+    /* exited since the listing, a kernel thread or not ours to read: leave it at zero */
+    if (PTR_ERR_OR_ZERO(task) == -EACCES)
+        p->rec.flags |= MT_SHARE_DENIED;
+    if (IS_ERR(task))
+        return 0;
+    mm = get_task_mm(task);
+    put_task_struct(task);
+    if (!mm)
+        return 0;
+    if (mmap_read_lock_killable(mm)) {
+        mmput(mm);
+        return -EINTR;
+    }
+
+    vma_iter_init(&vmi, mm, 0);
+    while ((vma = vma_next(&vmi)))
+        walk_page_range(mm, vma->vm_start, vma->vm_end, &count_ops, &c);
+    p->rec.pgtables_kb = mm_pgtables_bytes(mm) >> 10;
+    mmap_read_unlock(mm);
     mmput(mm);
+
+    p->rec.rss_kb = counts.present_kb;
+    p->rec.shared_kb = counts.shared_kb;
+    p->rec.uss_kb = counts.present_kb - counts.shared_kb;
+    p->rec.swap_kb = counts.swap_kb;
+    p->rec.pss_kb = c.pss >> (PSS_SHIFT + 10);
+    return 0;
+}
+
+static void release_subtree(struct subtree_target *st)
+{
+    size_t i;
+
+    for (i = 0; i < st->count; i++)
+        put_pid(st->procs[i].pid);
+    kvfree(st->procs);
+    st->procs = NULL;
+    st->count = 0;
+}
+
+/* Sorts every shared page seen into inside or outside the subtree */
+static void tally_shared(struct subtree_target *st, struct share_table *share)
+{
+    unsigned long index, v, kb, n = 0;
+    void *entry;
+
+    xa_for_each(&share->pages, index, entry) {
+        v = xa_to_value(entry);
+        kb = (PAGE_SIZE << SHARE_ORDER(v)) >> 10;
+        if (SHARE_COUNT(v) >= SHARE_SHARERS(v))
+            st->hdr.inside_kb += kb;
+        else
+            st->hdr.outside_kb += kb;
+        if (!(++n % 4096))
+            cond_resched();
+    }
+}
+
+static int snapshot_subtree(struct subtree_target *st)
+{
+    struct share_table *share;
+    size_t total, cap, i;
+    int err = 0;
+
+    release_subtree(st);
+    memset(&st->hdr, 0, sizeof(st->hdr));
+    if (!st->target.pid)
+        return -EINVAL;
+
+    total = list_subtree(st->target.pid, NULL, 0);
+    if (!total)
+        return -ESRCH;
+    cap = total + SUBTREE_SLACK;
+    st->procs = kvcalloc(cap, sizeof(*st->procs), GFP_KERNEL);
+    share = kvzalloc(sizeof(*share), GFP_KERNEL);
+    if (!st->procs || !share) {
+        kvfree(share);
+        return -ENOMEM;
+    }
+    st->count = min(list_subtree(st->target.pid, st->procs, cap), cap);
+
+    xa_init(&share->pages);
+    for (i = 0; i < st->count && !err; i++) {
+        struct mt_share *rec = &st->procs[i].rec;
+
+        err = fatal_signal_pending(current) ? -EINTR : walk_share(&st->procs[i], share);
+        if (rec->flags & MT_SHARE_DENIED)
+            st->hdr.flags |= MT_SUBTREE_DENIED;
+        st->hdr.rss_kb += rec->rss_kb;
+        st->hdr.pss_kb += rec->pss_kb;
+        st->hdr.uss_kb += rec->uss_kb;
+        st->hdr.swap_kb += rec->swap_kb;
+        st->hdr.pgtables_kb += rec->pgtables_kb;
+    }
+    tally_shared(st, share);
+    if (share->partial)
+        st->hdr.flags |= MT_SUBTREE_PARTIAL;
+    xa_destroy(&share->pages);
+    kvfree(share);
+    return err;
+}
+
+static void *subtree_start(struct seq_file *m, loff_t *pos)
+{
+    struct subtree_target *st = m->private;
+    int err;
+
+    if (*pos == 0) {
+        err = snapshot_subtree(st);
+        return err ? ERR_PTR(err) : SEQ_START_TOKEN;
+    }
+    return *pos <= st->count ? &st->procs[*pos - 1] : NULL;
+}
+
+static void *subtree_next(struct seq_file *m, void *v, loff_t *pos)
+{
+    struct subtree_target *st = m->private;
+
+    (*pos)++;
+    return *pos <= st->count ? &st->procs[*pos - 1] : NULL;
+}
+
+static int subtree_show(struct seq_file *m, void *v)
+{
+    struct subtree_target *st = m->private;
+    struct mt_subtree_header hdr;
+
+    if (v == SEQ_START_TOKEN) {
+        hdr = st->hdr;
+        hdr.magic = MT_SUBTREE_MAGIC;
+        hdr.version = MT_VERSION;
+        hdr.header_size = sizeof(hdr);
+        hdr.record_size = sizeof(struct mt_share);
+        hdr.pid = pid_vnr(st->target.pid);
+        hdr.count = st->count;
+        seq_write(m, &hdr, sizeof(hdr));
+        return 0;
+    }
+    seq_write(m, &((struct subtree_proc *)v)->rec, sizeof(struct mt_share));
     return 0;
 }
 
+static const struct seq_operations subtree_seq_ops = {
+    .start = subtree_start,
+    .next  = subtree_next,
+    .stop  = pages_stop,
+    .show  = subtree_show
+};
+
+static int open_target(struct file *file, int (*show)(struct seq_file *, void *))
+{
+    struct map_target *target = kzalloc(sizeof(*target), GFP_KERNEL);
+    int ret;
+
+    if (!target)
+        return -ENOMEM;
+    ret = single_open(file, show, target);
+    if (ret)
+        kfree(target);
+    return ret;
+}
+
 /* Open function for the proc file */
 static int mem_map_open(struct inode *inode, struct file *file)
 {
-        return single_open(file, mem_map_show, NULL);  // If no private data needed
+    return open_target(file, mem_map_show);
+}
+
+static int mem_summary_open(struct inode *inode, struct file *file)
+{
+    return open_target(file, mem_summary_show);
+}
+
+static int mem_map_release(struct inode *inode, struct file *file)
+{
+    struct seq_file *m = file->private_data;
+    struct map_target *target = m->private;
+
+    put_pid(target->pid);
+    kfree(target);
+    return single_release(inode, file);
+}
+
+static int mem_pages_open(struct inode *inode, struct file *file)
+{
+    return __seq_open_private(file, &pages_seq_ops, sizeof(struct map_target)) ? 0 : -ENOMEM;
+}
+
+static int mem_pages_release(struct inode *inode, struct file *file)
+{
+    struct seq_file *m = file->private_data;
+    struct map_target *target = m->private;
+
+    put_pid(target->pid);
+    kvfree(target->vmas);
+    return seq_release_private(inode, file);
+}
+
+static int mem_subtree_open(struct inode *inode, struct file *file)
+{
+    return __seq_open_private(file, &subtree_seq_ops, sizeof(struct subtree_target)) ? 0 : -ENOMEM;
+}
+
+static int mem_subtree_release(struct inode *inode, struct file *file)
+{
+    struct seq_file *m = file->private_data;
+    struct subtree_target *st = m->private;
+
+    put_pid(st->target.pid);
+    release_subtree(st);
+    return seq_release_private(inode, file);
+}
+
+/* Writing a pid selects the process; the next read from offset 0 shows its map */
+static ssize_t mem_map_write(struct file *file, const char __user *buffer, size_t count, loff_t *pos)
+{
+    struct seq_file *m = file->private_data;
+    struct map_target *target = m->private;
+    struct task_struct *task;
+    struct pid *pid;
+    char kbuf[16];
+    int nr;
+
+    if (count >= sizeof(kbuf))
+        return -EINVAL;
+
+    if (copy_from_user(kbuf, buffer, count))
+        return -EFAULT;
+
+    kbuf[count] = '\0';
+    if (kstrtoint(kbuf, 10, &nr) < 0 || nr <= 0)
+        return -EINVAL;
+
+    pid = find_get_pid(nr);
+    if (!pid)
+        return -ESRCH;
+    task = get_readable_task(pid, PIDTYPE_PID);
+    if (IS_ERR(task)) {
+        put_pid(pid);
+        return PTR_ERR(task);
+    }
+    put_task_struct(task);
+
+    mutex_lock(&m->lock);
+    put_pid(target->pid);
+    target->pid = pid;
+    mutex_unlock(&m->lock);
+    return count;
 }
 
 static const struct proc_ops mem_map_fops = {
     .proc_open    = mem_map_open,
     .proc_read    = seq_read,
+    .proc_write   = mem_map_write,
+    .proc_lseek   = seq_lseek,
+    .proc_release = mem_map_release,
+};
+
+static const struct proc_ops mem_summary_fops = {
+    .proc_open    = mem_summary_open,
+    .proc_read    = seq_read,
+    .proc_write   = mem_map_write,
+    .proc_lseek   = seq_lseek,
+    .proc_release = mem_map_release,
+};
+
+static const struct proc_ops mem_pages_fops = {
+    .proc_open    = mem_pages_open,
+    .proc_read    = seq_read,
+    .proc_write   = mem_map_write,
+    .proc_lseek   = seq_lseek,
+    .proc_release = mem_pages_release,
+};
+
+static const struct proc_ops mem_subtree_fops = {
+    .proc_open    = mem_subtree_open,
+    .proc_read    = seq_read,
+    .proc_write   = mem_map_write,
     .proc_lseek   = seq_lseek,
-    .proc_release = single_release,
+    .proc_release = mem_subtree_release,
 };
 
-/* Create proc entries for all processes */
 static int __init mem_tree_init(void)
 {
-    struct task_struct *task;
-    char pid_name[16];
-    struct proc_dir_entry *entry;
-
     /* Create /proc/mem_tree directory */
     proc_mem_tree = proc_mkdir(PROC_DIR, NULL);
     if (!proc_mem_tree) {
@@ -74,31 +773,35 @@ static int __init mem_tree_init(void)
         return -ENOMEM;
     }
 
-    for_each_process(task) {
-        snprintf(pid_name, sizeof(pid_name), "%d", task->pid);
-
-        entry = proc_create_data(pid_name, 0444, proc_mem_tree, &mem_map_fops, task);
-        if (!entry) {
-            printk(KERN_ERR "Failed to create /proc/%s/%s\n", PROC_DIR, pid_name);
-        }
+    if (!proc_create(MAP_FILE, 0666, proc_mem_tree, &mem_map_fops)) {
+        printk(KERN_ERR "Failed to create /proc/%s/%s\n", PROC_DIR, MAP_FILE);
+        remove_proc_entry(PROC_DIR, NULL);
+        return -ENOMEM;
+    }
+    if (!proc_create(MT_SUMMARY_FILE, 0666, proc_mem_tree, &mem_summary_fops)) {
+        printk(KERN_ERR "Failed to create /proc/%s/%s\n", PROC_DIR, MT_SUMMARY_FILE);
+        remove_proc_subtree(PROC_DIR, NULL);
+        return -ENOMEM;
+    }
+    if (!proc_create(MT_PAGES_FILE, 0666, proc_mem_tree, &mem_pages_fops)) {
+        printk(KERN_ERR "Failed to create /proc/%s/%s\n", PROC_DIR, MT_PAGES_FILE);
+        remove_proc_subtree(PROC_DIR, NULL);
+        return -ENOMEM;
+    }
+    /* walking a whole subtree is costly: only root may start one */
+    if (!proc_create(MT_SUBTREE_FILE, 0600, proc_mem_tree, &mem_subtree_fops)) {
+        printk(KERN_ERR "Failed to create /proc/%s/%s\n", PROC_DIR, MT_SUBTREE_FILE);
+        remove_proc_subtree(PROC_DIR, NULL);
+        return -ENOMEM;
     }
 
     printk(KERN_INFO "Memory Tree Module Loaded.\n");
     return 0;
 }
 
-/* Remove all proc entries on exit */
 static void __exit mem_tree_exit(void)
 {
-    struct task_struct *task;
-    char pid_name[16];
-
-    for_each_process(task) {
-        snprintf(pid_name, sizeof(pid_name), "%d", task->pid);
-        remove_proc_entry(pid_name, proc_mem_tree);
-    }
-
-    remove_proc_entry(PROC_DIR, NULL);
+    remove_proc_subtree(PROC_DIR, NULL);
     printk(KERN_INFO "Memory Tree Module Unloaded.\n");
 }
 
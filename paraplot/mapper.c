@@ -8,127 +8,278 @@
 #include <linux/mm.h>
 #include <linux/rcupdate.h>
 #include <linux/uaccess.h>
+#include <linux/slab.h>
+#include <linux/pid.h>
+#include <linux/ptrace.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/task.h>
+#include <linux/mmap_lock.h>
+
+#include "../_ps_plus/task_walk.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Uday Gopan");
 MODULE_DESCRIPTION("Linux Kernel Module for displaying process ID and memory maps of child processes");
-MODULE_VERSION("0.3");
+MODULE_VERSION("0.4");
 
+/* Root for open files that never write one; each file's own roots live in its child_tree_target */
 static int parent_pid = 1;
 module_param(parent_pid, int, 0444);
-MODULE_PARM_DESC(parent_pid, "PID of the parent process");
+MODULE_PARM_DESC(parent_pid, "PID shown by /proc/child_tree until a pid is written to it");
 
-static ssize_t proc_write(struct file *file, const char __user *buffer, size_t count, loff_t *pos)
-{
-    char kbuf[16];
-    long new_pid;
+#define MAX_ROOTS   16
+#define ROOTS_TEXT  256     /* longest write accepted: MAX_ROOTS pids and separators */
+#define ENTRY_SLACK 64      /* room for forks between counting and listing */
 
-    if (count >= sizeof(kbuf)) 
-        return -EINVAL;
+/*
+ * /proc/child_tree: each open file writes its own root pids, separated
+ * by spaces or commas, and reads the subtree under each. The pids are
+ * resolved when written, so every reader has its own view and a write
+ * never disturbs another reader.
+ */
+struct child_tree_target {
+    struct pid *roots[MAX_ROOTS];
+    int nr_roots;
+};
 
-    if (copy_from_user(kbuf, buffer, count))
-        return -EFAULT;
+struct tree_entry {
+    struct pid *pid;
+    pid_t nr;
+    pid_t ppid;
+    int depth;
+    bool leaf;
+};
 
-    kbuf[count] = '\0';
-    if (kstrtol(kbuf, 10, &new_pid) < 0)
-        return -EINVAL;
+/* Lists up to max tasks of the subtree into out; returns how many there are */
+static size_t list_subtree(struct pid *root_pid, struct tree_entry *out, size_t max)
+{
+    struct task_struct *root, *task;
+    size_t n = 0;
+    int depth = 0;
 
-    parent_pid = (int)new_pid;
-    printk(KERN_INFO "Updated parent PID: %d\n", parent_pid);
-    return count;
+    rcu_read_lock();
+    root = pid_task(root_pid, PIDTYPE_PID);
+    for (task = root; task; task = task_walk_next(root, task, &depth)) {
+        if (task != root && task->exit_state == EXIT_DEAD)
+            continue;
+        if (n < max) {
+            out[n].pid = get_pid(task_pid(task));
+            out[n].nr = task_pid_vnr(task);
+            out[n].ppid = task == root ? 0 : task_pid_vnr(rcu_dereference(task->real_parent));
+            out[n].depth = depth;
+            out[n].leaf = list_empty(&task->children);
+        }
+        n++;
+    }
+    rcu_read_unlock();
+    return n;
 }
 
-static void print_memory_map(struct seq_file *m, struct task_struct *task, int indent)
+static void print_indent(struct seq_file *m, int indent)
 {
-    struct mm_struct *mm;
-    struct vm_area_struct *vma;
-    struct vma_iterator vmi;
     int i;
 
+    for (i = 0; i < indent; i++)
+        seq_putc(m, ' ');
+}
+
+/* 0 if the caller may read pid's memory map, as for /proc/<pid>/maps; else -ESRCH or -EACCES */
+static int check_readable(struct pid *pid)
+{
+    struct task_struct *task = get_pid_task(pid, PIDTYPE_PID);
+    int ret = 0;
+
     if (!task)
-        return;
+        return -ESRCH;
+    if (!ptrace_may_access(task, PTRACE_MODE_READ_FSCREDS))
+        ret = -EACCES;
+    put_task_struct(task);
+    return ret;
+}
 
-    mm = get_task_mm(task);
+static int print_memory_map(struct seq_file *m, struct tree_entry *entry, int indent)
+{
+    struct task_struct *task = get_pid_task(entry->pid, PIDTYPE_PID);
+    struct mm_struct *mm = NULL;
+    struct vm_area_struct *vma;
+    struct vma_iterator vmi;
+
+    if (task && !ptrace_may_access(task, PTRACE_MODE_READ_FSCREDS)) {
+        put_task_struct(task);
+        print_indent(m, indent);
+        seq_printf(m, "No access to memory map for process %d\n", entry->nr);
+        return 0;
+    }
+    if (task) {
+        mm = get_task_mm(task);
+        put_task_struct(task);
+    }
     if (!mm) {
-        for (i = 0; i < indent; i++)
-            seq_putc(m, ' ');
-        seq_printf(m, "No memory map for process %d\n", task->pid);
-        return;
+        print_indent(m, indent);
+        seq_printf(m, "No memory map for process %d\n", entry->nr);
+        return 0;
+    }
+    if (mmap_read_lock_killable(mm)) {
+        mmput(mm);
+        return -EINTR;
     }
 
-    for (i = 0; i < indent; i++)
-        seq_putc(m, ' ');
-    seq_printf(m, "Memory map for process %d:\n", task->pid);
+    print_indent(m, indent);
+    seq_printf(m, "Memory map for process %d:\n", entry->nr);
 
     vma_iter_init(&vmi, mm, 0);
     while ((vma = vma_next(&vmi))) {
-        for (i = 0; i < indent; i++)
-            seq_putc(m, ' ');
+        print_indent(m, indent);
         seq_printf(m, "  Start: %lx, End: %lx, Flags: %lx\n",
                    vma->vm_start, vma->vm_end, vma->vm_flags);
     }
 
+    mmap_read_unlock(mm);
     mmput(mm);
+    return 0;
 }
 
-static void print_child_processes(struct seq_file *m, struct task_struct *task, int indent)
+/*
+ * The subtree is listed under RCU first and printed afterwards, so the
+ * memory maps can be read with the mmap lock held.
+ */
+static int print_subtree(struct seq_file *m, struct pid *root, int nr)
 {
-    struct task_struct *child;
-    int i;
+    struct tree_entry *entries;
+    size_t count, cap, i;
+    int indent, ret = 0;
 
-    if (!task)
-        return;
+    if (!root) {
+        seq_printf(m, "Invalid parent PID: %d\n", nr);
+        return 0;
+    }
 
-    rcu_read_lock();
-    if (list_empty(&task->children)) {
-        for (i = 0; i < indent; i++)
-            seq_putc(m, ' ');
-        seq_printf(m, "|- No children for PID: %d\n", task->pid);
-    } else {
-        list_for_each_entry_rcu(child, &task->children, sibling) {
-            if (!child || child->exit_state == EXIT_DEAD)
-                continue;
-
-            for (i = 0; i < indent; i++)
-                seq_putc(m, ' ');
-            seq_printf(m, "|- Child PID: %d (Parent PID: %d)\n", child->pid, task->pid);
-
-            print_memory_map(m, child, indent + 2);
-            print_child_processes(m, child, indent + 2);
+    count = list_subtree(root, NULL, 0);
+    if (!count) {
+        seq_printf(m, "No task found for PID: %d\n", nr);
+        return 0;
+    }
+    cap = count + ENTRY_SLACK;
+    entries = kvcalloc(cap, sizeof(*entries), GFP_KERNEL);
+    if (!entries)
+        return -ENOMEM;
+    count = min(list_subtree(root, entries, cap), cap);
+
+    for (i = 0; i < count; i++) {
+        indent = 2 * entries[i].depth;
+        if (i == 0) {
+            seq_printf(m, "Parent process ID: %d\n", entries[i].nr);
+        } else {
+            print_indent(m, indent);
+            seq_printf(m, "|- Child PID: %d (Parent PID: %d)\n", entries[i].nr, entries[i].ppid);
+            ret = print_memory_map(m, &entries[i], indent + 2);
+            if (ret)
+                break;
+        }
+        if (entries[i].leaf) {
+            print_indent(m, indent + 2);
+            seq_printf(m, "|- No children for PID: %d\n", entries[i].nr);
         }
     }
-    rcu_read_unlock();
-}
 
+    for (i = 0; i < count; i++)
+        put_pid(entries[i].pid);
+    kvfree(entries);
+    return ret;
+}
 
 static int seq_show(struct seq_file *m, void *v)
 {
-    struct pid *pid_struct;
-    struct task_struct *parent_task;
+    struct child_tree_target *target = m->private;
+    struct pid *pid;
+    int i, ret = 0;
 
-    pid_struct = find_get_pid(parent_pid);
-    if (!pid_struct) {
-        seq_printf(m, "Invalid parent PID: %d\n", parent_pid);
-        return 0;
+    if (!target->nr_roots) {
+        pid = find_get_pid(parent_pid);
+        ret = print_subtree(m, pid, parent_pid);
+        put_pid(pid);
+        return ret;
     }
 
-    parent_task = pid_task(pid_struct, PIDTYPE_PID);
-    if (!parent_task) {
-        seq_printf(m, "No task found for PID: %d\n", parent_pid);
-        put_pid(pid_struct);
-        return 0;
-    }
+    for (i = 0; i < target->nr_roots && !ret; i++)
+        ret = print_subtree(m, target->roots[i], pid_vnr(target->roots[i]));
+    return ret;
+}
 
-    seq_printf(m, "Parent process ID: %d\n", parent_task->pid);
-    print_child_processes(m, parent_task, 2);
+static void put_roots(struct pid **roots, int count)
+{
+    while (count > 0)
+        put_pid(roots[--count]);
+}
 
-    put_pid(pid_struct);
-    return 0;
+/*
+ * Writing pids replaces this file's roots; an empty write goes back to
+ * parent_pid. The writer must be able to read each root's maps, and
+ * every child's map is checked again against the reader when printed.
+ */
+static ssize_t proc_write(struct file *file, const char __user *buffer, size_t count, loff_t *pos)
+{
+    struct seq_file *m = file->private_data;
+    struct child_tree_target *target = m->private;
+    struct pid *roots[MAX_ROOTS];
+    char kbuf[ROOTS_TEXT], *text = kbuf, *token;
+    int nr, nr_roots = 0, ret;
+
+    if (count >= sizeof(kbuf))
+        return -EINVAL;
+
+    if (copy_from_user(kbuf, buffer, count))
+        return -EFAULT;
+
+    kbuf[count] = '\0';
+    while ((token = strsep(&text, " ,\t\n"))) {
+        if (!*token)
+            continue;
+        if (nr_roots == MAX_ROOTS || kstrtoint(token, 10, &nr) < 0 || nr <= 0) {
+            put_roots(roots, nr_roots);
+            return -EINVAL;
+        }
+        roots[nr_roots] = find_get_pid(nr);
+        if (!roots[nr_roots]) {
+            put_roots(roots, nr_roots);
+            return -ESRCH;
+        }
+        ret = check_readable(roots[nr_roots++]);
+        if (ret) {
+            put_roots(roots, nr_roots);
+            return ret;
+        }
+    }
+
+    mutex_lock(&m->lock);
+    put_roots(target->roots, target->nr_roots);
+    memcpy(target->roots, roots, nr_roots * sizeof(roots[0]));
+    target->nr_roots = nr_roots;
+    mutex_unlock(&m->lock);
+    return count;
 }
 
 static int proc_open(struct inode *inode, struct file *file)
 {
-    return single_open(file, seq_show, NULL);
+    struct child_tree_target *target = kzalloc(sizeof(*target), GFP_KERNEL);
+    int ret;
+
+    if (!target)
+        return -ENOMEM;
+    ret = single_open(file, seq_show, target);
+    if (ret)
+        kfree(target);
+    return ret;
+}
+
+static int proc_release(struct inode *inode, struct file *file)
+{
+    struct seq_file *m = file->private_data;
+    struct child_tree_target *target = m->private;
+
+    put_roots(target->roots, target->nr_roots);
+    kfree(target);
+    return single_release(inode, file);
 }
 
 static const struct proc_ops proc_fops = {
@@ -136,7 +287,7 @@ static const struct proc_ops proc_fops = {
     .proc_read    = seq_read,
     .proc_write   = proc_write,
     .proc_lseek   = seq_lseek,
-    .proc_release = single_release
+    .proc_release = proc_release
 };
 
 static int __init mapper_init(void)
@@ -146,7 +297,7 @@ static int __init mapper_init(void)
         printk(KERN_ERR "Failed to create /proc/child_tree\n");
         return -ENOMEM;
     }
-    printk(KERN_INFO "Mapper Module Loaded: Monitoring parent PID: %d\n", parent_pid);
+    printk(KERN_INFO "Mapper Module Loaded: default parent PID: %d\n", parent_pid);
     return 0;
 }
 
@@ -7,16 +7,21 @@
 #include <fcntl.h>
 
 #define NUM_CHILDREN 5  
-void write_parent_pid_to_proc() {
-    int fd = open("/proc/child_tree", O_WRONLY);
+/* The root is set per open file, so the same descriptor is read back later */
+int open_child_tree() {
+    int fd = open("/proc/child_tree", O_RDWR);
     if (fd < 0) {
         perror("Error opening /proc/child_tree");
-        return;
+        return -1;
     }
     char buf[32];
     snprintf(buf, sizeof(buf), "%d", getpid()); 
-    write(fd, buf, strlen(buf));
-    close(fd);
+    if (write(fd, buf, strlen(buf)) < 0) {
+        perror("Error writing /proc/child_tree");
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
 void print_tree_format(const char *buffer) {
@@ -45,7 +50,9 @@ void print_tree_format(const char *buffer) {
 
 
 int main() {
-    write_parent_pid_to_proc();  
+    int fd = open_child_tree();
+    if (fd < 0)
+        return 1;
 
     pid_t pids[NUM_CHILDREN];
 
@@ -69,12 +76,7 @@ int main() {
     sleep(2);
 
     char buffer[8192];
-    int fd = open("/proc/child_tree", O_RDONLY);
-    if (fd < 0) {
-        perror("Error opening /proc/child_tree");
-        return 1;
-    }
-    ssize_t bytesRead = read(fd, buffer, sizeof(buffer) - 1);
+    ssize_t bytesRead = pread(fd, buffer, sizeof(buffer) - 1, 0);
     if (bytesRead < 0) {
         perror("Error reading /proc/child_tree");
         close(fd);